@@ -0,0 +1,391 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "poly.h"
+#include "poly_async.h"
+#include "poly_mod.h"
+
+// Batch driver: reads a job file (or stdin) and runs its operations on the
+// poly_async pool, streaming each result out in job order.
+//
+//   driver [--binary] [--jobs N] [job_file]
+//
+// Job file lines, with # starting a comment:
+//
+//   poly <name>                  terms follow, one cx^p per line, up to ";"
+//                                (no comments inside the terms)
+//   load <file> <name>...        the next polynomials in file, in order
+//   mul <out> <a> <b>            out = a * b
+//   add <out> <a> <b>            out = a + b
+//   mod <out> <a> <b>            out = a % b
+//   pow <out> <a> <k>            out = a^k
+//   eval <out> <a> <x>...        a at each x, modulo modular::MOD; each x
+//                                is reduced modulo modular::MOD first
+//   drop <name>                  forget name so its terms can be freed
+//
+// Operations and parses start as soon as their inputs are ready. At most N of
+// them (default 2 * NUM_THREADS) are in flight; past that the driver waits for
+// the oldest, writing out its result, before reading on. That bounds the work
+// queued ahead of the output, not the total memory: every named polynomial,
+// parsed or computed, stays alive until a later line drops or reassigns its
+// name, so long job files should drop names they no longer need.
+//
+// Text output is "# <name>" followed by the polynomial in polynomial::write()
+// format, or by one value per line and ";" for eval. Binary output is, per
+// result, little-endian: u8 kind (0 polynomial, 1 values), u64 name length,
+// the name, u64 count, then count (u64 power, i32 coeff) pairs or count u32
+// values.
+//
+// A line that cannot run (unknown name or operation, bad number) is reported
+// on stderr and skipped, and the exit status is 1; the rest of the batch
+// still runs. A failed job is reported when its result is due.
+//
+// Per-job timings and the overall throughput go to stderr at the end.
+
+using values = std::vector<uint32_t>;
+
+struct job
+{
+    size_t line;
+    std::string op, name;
+    std::optional<poly_async::future<polynomial>> poly;
+    std::optional<poly_async::future<values>> vals;
+    // Parses only occupy a slot; their polynomials are not written out.
+    bool emit = true;
+    // Set by the pool thread that runs the job; read after get() returns.
+    std::shared_ptr<double> ms = std::make_shared<double>(0);
+};
+
+struct job_error : std::runtime_error
+{
+    job_error(size_t line, const std::string &message)
+        : std::runtime_error("line " + std::to_string(line) + ": " + message) {}
+};
+
+template <typename F>
+static auto timed(std::shared_ptr<double> ms, F f) {
+    return [ms, f](const auto &...args) {
+        auto begin = std::chrono::steady_clock::now();
+        auto result = f(args...);
+        *ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        return result;
+    };
+}
+
+static void put_u64(std::ostream &out, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        out.put(static_cast<char>(v >> (8 * i)));
+    }
+}
+
+static void put_u32(std::ostream &out, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        out.put(static_cast<char>(v >> (8 * i)));
+    }
+}
+
+class driver
+{
+private:
+    bool binary;
+    size_t max_in_flight;
+    std::map<std::string, poly_async::future<polynomial>> names;
+    std::deque<job> in_flight;
+    std::vector<std::pair<job, double>> finished;
+    size_t result_terms = 0;
+    int status = 0;
+
+    const poly_async::future<polynomial> &operand(size_t line, const std::string &name) const {
+        auto found = names.find(name);
+        if (found == names.end()) {
+            throw job_error(line, "unknown polynomial " + name);
+        }
+        return found -> second;
+    }
+
+    static std::string read_terms(std::istream &in, size_t &line) {
+        std::string text, s;
+        while (std::getline(in, s)) {
+            line++;
+            text += s + '\n';
+            if (s == ";" || s == ";\r") {
+                return text;
+            }
+        }
+        return text;
+    }
+
+    void write_result(job &j) {
+        if (!j.emit) {
+            j.poly -> get();
+        }
+        else if (j.poly) {
+            const polynomial &p = j.poly -> get();
+            auto terms = p.canonical_form();
+            result_terms += p.term_count();
+            if (binary) {
+                std::cout.put(0);
+                put_u64(std::cout, j.name.size());
+                std::cout << j.name;
+                put_u64(std::cout, p.term_count());
+                for (auto i = terms.rbegin(); i != terms.rend(); i++) {
+                    if (i -> second != 0) {
+                        put_u64(std::cout, i -> first);
+                        put_u32(std::cout, static_cast<uint32_t>(i -> second));
+                    }
+                }
+            }
+            else {
+                std::cout << "# " << j.name << '\n';
+                p.write(std::cout);
+            }
+        }
+        else {
+            const values &v = j.vals -> get();
+            result_terms += v.size();
+            if (binary) {
+                std::cout.put(1);
+                put_u64(std::cout, j.name.size());
+                std::cout << j.name;
+                put_u64(std::cout, v.size());
+                for (uint32_t x : v) {
+                    put_u32(std::cout, x);
+                }
+            }
+            else {
+                std::cout << "# " << j.name << '\n';
+                for (uint32_t x : v) {
+                    std::cout << x << '\n';
+                }
+                std::cout << ";\n";
+            }
+        }
+    }
+
+    void retire_oldest() {
+        job j = std::move(in_flight.front());
+        in_flight.pop_front();
+        try {
+            write_result(j);
+        }
+        catch (const std::exception &e) {
+            std::cerr << "driver: line " << j.line << " (" << j.op << " " << j.name << ") failed: " << e.what() << std::endl;
+            status = 1;
+        }
+        finished.emplace_back(std::move(j), 0);
+        finished.back().second = *finished.back().first.ms;
+        // The output stream is done with the result; only the name keeps it.
+        finished.back().first.poly.reset();
+        finished.back().first.vals.reset();
+    }
+
+    void submit(job j) {
+        in_flight.push_back(std::move(j));
+        while (in_flight.size() > max_in_flight) {
+            retire_oldest();
+        }
+    }
+
+    void submit_parse(size_t line, const std::string &op, const std::string &name, std::string text) {
+        job j{line, op, name};
+        j.emit = false;
+        j.poly = poly_async::async(timed(j.ms, [text = std::move(text)] {
+            std::istringstream in(text);
+            return polynomial::parse(in);
+        }));
+        names.insert_or_assign(name, *j.poly);
+        submit(std::move(j));
+    }
+
+    void run_line(std::istream &in, const std::string &s, size_t &line) {
+        std::istringstream words(s.substr(0, s.find('#')));
+        std::string op;
+        if (!(words >> op)) {
+            return;
+        }
+        std::vector<std::string> args;
+        for (std::string w; words >> w; ) {
+            args.push_back(w);
+        }
+        size_t at = line;
+        auto need = [&](size_t count, bool at_least = false) {
+            if (at_least ? args.size() < count : args.size() != count) {
+                throw job_error(at, "wrong number of arguments to " + op);
+            }
+        };
+
+        if (op == "poly") {
+            need(1);
+            submit_parse(at, op, args[0], read_terms(in, line));
+        }
+        else if (op == "load") {
+            need(2, true);
+            std::ifstream file(args[0]);
+            if (!file) {
+                throw job_error(at, "cannot open " + args[0]);
+            }
+            size_t file_line = 0;
+            for (size_t i = 1; i < args.size(); i++) {
+                std::string text = read_terms(file, file_line);
+                if (text.empty()) {
+                    throw job_error(at, args[0] + " has no polynomial for " + args[i]);
+                }
+                submit_parse(at, op, args[i], std::move(text));
+            }
+        }
+        else if (op == "drop") {
+            need(1);
+            names.erase(args[0]);
+        }
+        else if (op == "mul" || op == "add" || op == "mod") {
+            need(3);
+            job j{at, op, args[0]};
+            const auto &a = operand(at, args[1]);
+            const auto &b = operand(at, args[2]);
+            if (op == "mul") {
+                j.poly = poly_async::combine(a, b, timed(j.ms, [](const polynomial &x, const polynomial &y) { return x * y; }));
+            }
+            else if (op == "add") {
+                j.poly = poly_async::combine(a, b, timed(j.ms, [](const polynomial &x, const polynomial &y) { return x + y; }));
+            }
+            else {
+                j.poly = poly_async::combine(a, b, timed(j.ms, [](const polynomial &x, const polynomial &y) { return x % y; }));
+            }
+            names.insert_or_assign(j.name, *j.poly);
+            submit(std::move(j));
+        }
+        else if (op == "pow") {
+            need(3);
+            job j{at, op, args[0]};
+            size_t k = std::stoull(args[2]);
+            j.poly = operand(at, args[1]).then(timed(j.ms, [k](const polynomial &x) { return x.pow(k); }));
+            names.insert_or_assign(j.name, *j.poly);
+            submit(std::move(j));
+        }
+        else if (op == "eval") {
+            need(3, true);
+            job j{at, op, args[0]};
+            values xs;
+            for (size_t i = 2; i < args.size(); i++) {
+                // stoull would wrap a negative number instead of rejecting it.
+                if (args[i][0] == '-') {
+                    throw job_error(at, "negative evaluation point " + args[i]);
+                }
+                xs.push_back(static_cast<uint32_t>(std::stoull(args[i]) % modular::MOD));
+            }
+            j.vals = operand(at, args[1]).then(timed(j.ms, [xs](const polynomial &x) { return x.evaluate_mod(xs); }));
+            submit(std::move(j));
+        }
+        else {
+            throw job_error(at, "unknown operation " + op);
+        }
+    }
+
+public:
+    driver(bool binary, size_t max_in_flight) : binary(binary), max_in_flight(std::max<size_t>(max_in_flight, 1)) {}
+
+    int run(std::istream &in) {
+        auto begin = std::chrono::steady_clock::now();
+        std::string s;
+        size_t line = 0;
+        // A bad line is reported and skipped; later lines still run, and any
+        // that name its output fail as unknown.
+        while (std::getline(in, s)) {
+            line++;
+            size_t at = line;
+            try {
+                run_line(in, s, line);
+            }
+            catch (const job_error &e) {
+                std::cerr << "driver: " << e.what() << std::endl;
+                status = 1;
+            }
+            catch (const std::invalid_argument &e) {
+                // stoull and friends report bad numbers like this.
+                std::cerr << "driver: line " << at << ": bad number (" << e.what() << ")" << std::endl;
+                status = 1;
+            }
+            catch (const std::out_of_range &e) {
+                std::cerr << "driver: line " << at << ": number out of range (" << e.what() << ")" << std::endl;
+                status = 1;
+            }
+            catch (const std::exception &e) {
+                std::cerr << "driver: line " << at << ": " << e.what() << std::endl;
+                status = 1;
+            }
+        }
+        if (in.bad()) {
+            std::cerr << "driver: reading the job file failed after line " << line << std::endl;
+            status = 1;
+        }
+        while (!in_flight.empty()) {
+            retire_oldest();
+        }
+        std::cout.flush();
+        double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        report(total_ms);
+        return status;
+    }
+
+    void report(double total_ms) const {
+        std::cerr << std::fixed << std::setprecision(3);
+        double busy_ms = 0;
+        for (const auto& [j, ms] : finished) {
+            std::cerr << "line " << j.line << "  " << j.op << " " << j.name << "  " << ms << " ms" << std::endl;
+            busy_ms += ms;
+        }
+        double seconds = total_ms / 1000;
+        std::cerr << finished.size() << " jobs in " << total_ms << " ms (" << busy_ms << " ms of operations), "
+                  << (seconds > 0 ? finished.size() / seconds : 0) << " jobs/s, "
+                  << (seconds > 0 ? result_terms / seconds : 0) << " output terms/s" << std::endl;
+    }
+};
+
+static int usage() {
+    std::cerr << "usage: driver [--binary] [--jobs N] [job_file]" << std::endl;
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    bool binary = false;
+    size_t max_in_flight = 2 * NUM_THREADS;
+    std::string path = "-";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--binary") {
+            binary = true;
+        }
+        else if (arg == "--jobs" && i + 1 < argc) {
+            max_in_flight = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg.size() > 1 && arg[0] == '-') {
+            return usage();
+        }
+        else {
+            path = arg;
+        }
+    }
+
+    std::ios::sync_with_stdio(false);
+    driver d(binary, max_in_flight);
+    if (path == "-") {
+        return d.run(std::cin);
+    }
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "driver: cannot open " << path << std::endl;
+        return 1;
+    }
+    return d.run(file);
+}
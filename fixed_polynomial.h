@@ -0,0 +1,254 @@
+#ifndef FIXED_POLYNOMIAL_H
+#define FIXED_POLYNOMIAL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "poly.h"
+
+namespace fixed_detail {
+
+// Integer coefficients wrap like polynomial's instead of overflowing; the
+// common type with unsigned keeps narrow types from promoting to int.
+template <typename Coeff>
+using wide_unsigned = std::common_type_t<std::make_unsigned_t<Coeff>, unsigned>;
+
+template <typename Coeff>
+constexpr Coeff add(Coeff a, Coeff b) {
+    if constexpr (std::is_integral_v<Coeff>) {
+        using U = wide_unsigned<Coeff>;
+        return static_cast<Coeff>(static_cast<U>(a) + static_cast<U>(b));
+    }
+    else {
+        return a + b;
+    }
+}
+
+template <typename Coeff>
+constexpr Coeff sub(Coeff a, Coeff b) {
+    if constexpr (std::is_integral_v<Coeff>) {
+        using U = wide_unsigned<Coeff>;
+        return static_cast<Coeff>(static_cast<U>(a) - static_cast<U>(b));
+    }
+    else {
+        return a - b;
+    }
+}
+
+template <typename Coeff>
+constexpr Coeff mul(Coeff a, Coeff b) {
+    if constexpr (std::is_integral_v<Coeff>) {
+        using U = wide_unsigned<Coeff>;
+        return static_cast<Coeff>(static_cast<U>(a) * static_cast<U>(b));
+    }
+    else {
+        return a * b;
+    }
+}
+
+} // namespace fixed_detail
+
+/**
+ * A polynomial of degree below N with coefficients held inline in a
+ * std::array, index i being the coefficient of x^i. Every operation is
+ * constexpr and loops over compile-time bounds only, so small instances
+ * need no allocation and the optimizer can unroll them completely.
+ * Integer coefficients wrap on overflow and % follows polynomial::operator%.
+ */
+template <size_t N, typename Coeff = coeff>
+class fixed_polynomial
+{
+    static_assert(N > 0, "fixed_polynomial needs room for the constant term");
+
+private:
+    std::array<Coeff, N> terms{};
+
+public:
+    static constexpr size_t capacity = N;
+
+    /**
+     * @brief Construct the polynomial 0
+     */
+    constexpr fixed_polynomial() = default;
+
+    /**
+     * @brief Construct from coefficients listed from x^0 upwards
+     *
+     * @throws std::length_error
+     *  If there are more than N of them
+     */
+    constexpr fixed_polynomial(std::initializer_list<Coeff> low_to_high) {
+        if (low_to_high.size() > N) {
+            throw std::length_error("fixed_polynomial: too many coefficients");
+        }
+        size_t i = 0;
+        for (Coeff c : low_to_high) {
+            terms[i++] = c;
+        }
+    }
+
+    constexpr Coeff operator[](size_t i) const { return terms[i]; }
+    constexpr Coeff &operator[](size_t i) { return terms[i]; }
+
+    /**
+     * @brief Returns the highest power with a non-zero coefficient, or 0 for
+     *        the zero polynomial
+     */
+    constexpr size_t degree() const {
+        for (size_t i = N; i-- > 1; ) {
+            if (terms[i] != Coeff(0)) {
+                return i;
+            }
+        }
+        return 0;
+    }
+
+    constexpr bool is_zero() const {
+        for (size_t i = 0; i < N; i++) {
+            if (terms[i] != Coeff(0)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr fixed_polynomial operator+(const fixed_polynomial &other) const {
+        fixed_polynomial result;
+        for (size_t i = 0; i < N; i++) {
+            result.terms[i] = fixed_detail::add(terms[i], other.terms[i]);
+        }
+        return result;
+    }
+
+    /**
+     * @brief Returns the full product, whose capacity N + M - 1 holds every
+     *        coefficient so nothing is truncated
+     */
+    template <size_t M>
+    constexpr fixed_polynomial<N + M - 1, Coeff> operator*(const fixed_polynomial<M, Coeff> &other) const {
+        fixed_polynomial<N + M - 1, Coeff> result;
+        for (size_t i = 0; i < N; i++) {
+            for (size_t j = 0; j < M; j++) {
+                result[i + j] = fixed_detail::add(result[i + j], fixed_detail::mul(terms[i], other[j]));
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Returns the remainder of division by divisor. As with
+     *        polynomial::operator%, integer division stops at the first
+     *        leading coefficient the divisor's does not divide, and a zero
+     *        divisor leaves this polynomial unchanged.
+     */
+    template <size_t M>
+    constexpr fixed_polynomial operator%(const fixed_polynomial<M, Coeff> &divisor) const {
+        fixed_polynomial result = *this;
+        size_t divisor_degree = divisor.degree();
+        Coeff divisor_leading_coeff = divisor[divisor_degree];
+        if (divisor_leading_coeff == Coeff(0)) {
+            return result;
+        }
+
+        size_t remainder_degree = result.degree();
+        while (!result.is_zero() && remainder_degree >= divisor_degree) {
+            Coeff leading = result.terms[remainder_degree];
+            Coeff quotient{};
+            if constexpr (std::is_integral_v<Coeff> && std::is_signed_v<Coeff>) {
+                // Dividing the minimum value by -1 traps, so negate instead.
+                if (divisor_leading_coeff == Coeff(-1)) {
+                    quotient = fixed_detail::sub(Coeff(0), leading);
+                }
+                else if (leading % divisor_leading_coeff != 0) {
+                    break;
+                }
+                else {
+                    quotient = leading / divisor_leading_coeff;
+                }
+            }
+            else if constexpr (std::is_integral_v<Coeff>) {
+                if (leading % divisor_leading_coeff != 0) {
+                    break;
+                }
+                quotient = leading / divisor_leading_coeff;
+            }
+            else {
+                quotient = leading / divisor_leading_coeff;
+            }
+
+            size_t shift = remainder_degree - divisor_degree;
+            for (size_t i = 0; i <= divisor_degree; i++) {
+                result.terms[i + shift] = fixed_detail::sub(result.terms[i + shift], fixed_detail::mul(divisor[i], quotient));
+            }
+            // Exact for integers; keeps floating point from leaving a residue.
+            result.terms[remainder_degree] = Coeff(0);
+            remainder_degree = result.degree();
+        }
+        return result;
+    }
+
+    /**
+     * @brief Horner evaluation at x, wrapping like the other operations
+     */
+    constexpr Coeff evaluate(Coeff x) const {
+        Coeff result{};
+        for (size_t i = N; i-- > 0; ) {
+            result = fixed_detail::add(fixed_detail::mul(result, x), terms[i]);
+        }
+        return result;
+    }
+
+    constexpr bool operator==(const fixed_polynomial &other) const {
+        for (size_t i = 0; i < N; i++) {
+            if (terms[i] != other.terms[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr bool operator!=(const fixed_polynomial &other) const {
+        return !(*this == other);
+    }
+
+    /**
+     * @brief Copies p's terms without going through its canonical form
+     *
+     * @throws std::length_error
+     *  If p has degree N or more
+     */
+    static fixed_polynomial from(const polynomial &p) {
+        fixed_polynomial result;
+        p.for_each_term([&](power i, coeff c) {
+            if (i >= N) {
+                throw std::length_error("fixed_polynomial::from: degree too large");
+            }
+            result.terms[i] = static_cast<Coeff>(c);
+        });
+        return result;
+    }
+
+    /**
+     * @brief Returns the same polynomial as a polynomial, building it from a
+     *        term list on the stack
+     */
+    polynomial to_polynomial() const {
+        static_assert(std::is_integral_v<Coeff>, "only integer coefficients convert to polynomial");
+        std::array<std::pair<power, coeff>, N> nonzero{};
+        size_t count = 0;
+        for (size_t i = 0; i < N; i++) {
+            // Wider integer types keep their low 32 bits, as coeff would.
+            coeff c = static_cast<coeff>(static_cast<uint32_t>(terms[i]));
+            if (c != 0) {
+                nonzero[count++] = {i, c};
+            }
+        }
+        return polynomial(nonzero.begin(), nonzero.begin() + count);
+    }
+};
+
+#endif
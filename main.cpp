@@ -10,7 +10,19 @@
 #include <fstream>
 #include <stdexcept>
 #include <algorithm>
+#include <random>
+#include <map>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
 #include "poly.h"
+#include "fixed_polynomial.h"
+#include "poly_async.h"
+#include "poly_cache.h"
+#include "poly_profile.h"
+#include "poly_shard.h"
+#include <sys/socket.h>
+#include <unistd.h>
 
 std::vector<std::pair<power, coeff>> parse_polynomial(std::ifstream& file) {
     std::vector<std::pair<power, coeff>> result;
@@ -170,6 +182,770 @@ std::optional<double> poly_test(polynomial& p1,
     return std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
 }
 
+// ---------------------------------------------------------------------------
+// Differential testing: every fast kernel is checked against a slow, exact
+// reference. Coefficients wrap modulo 2^32 like plain int arithmetic.
+// ---------------------------------------------------------------------------
+
+using term_map = std::map<power, coeff>;
+
+term_map nonzero_terms(const std::vector<std::pair<power, coeff>>& terms) {
+    std::map<power, uint32_t> sums;
+    for (const auto& [p, c] : terms) {
+        sums[p] += static_cast<uint32_t>(c);
+    }
+    term_map result;
+    for (const auto& [p, c] : sums) {
+        if (c != 0) {
+            result[p] = static_cast<coeff>(c);
+        }
+    }
+    return result;
+}
+
+std::vector<std::pair<power, coeff>> to_canonical(const term_map& m) {
+    std::vector<std::pair<power, coeff>> result(m.rbegin(), m.rend());
+    if (result.empty()) {
+        return {std::make_pair(0, 0)};
+    }
+    return result;
+}
+
+term_map reference_multiply(const term_map& a, const term_map& b) {
+    if (a.empty() || b.empty()) {
+        return {};
+    }
+    std::vector<uint32_t> sums(a.rbegin() -> first + b.rbegin() -> first + 1);
+    for (const auto& [p1, c1] : a) {
+        for (const auto& [p2, c2] : b) {
+            sums[p1 + p2] += static_cast<uint32_t>(c1) * static_cast<uint32_t>(c2);
+        }
+    }
+    term_map result;
+    for (power p = 0; p < sums.size(); ++p) {
+        if (sums[p] != 0) {
+            result[p] = static_cast<coeff>(sums[p]);
+        }
+    }
+    return result;
+}
+
+// Integer long division that stops as soon as a leading coefficient does not
+// divide evenly, matching the semantics of polynomial::operator%.
+term_map reference_mod(term_map a, const term_map& b) {
+    if (b.empty()) {
+        return a;
+    }
+    auto [db, lb] = *b.rbegin();
+    while (!a.empty() && a.rbegin() -> first >= db) {
+        auto [da, la] = *a.rbegin();
+        if (static_cast<int64_t>(la) % lb != 0) {
+            break;
+        }
+        uint32_t q = static_cast<uint32_t>(static_cast<int64_t>(la) / lb);
+        for (const auto& [p, c] : b) {
+            power target = p + da - db;
+            uint32_t v = static_cast<uint32_t>(a[target]) - static_cast<uint32_t>(c) * q;
+            if (v == 0) {
+                a.erase(target);
+            }
+            else {
+                a[target] = static_cast<coeff>(v);
+            }
+        }
+    }
+    return a;
+}
+
+enum class poly_shape { sparse, dense, huge };
+
+std::vector<std::pair<power, coeff>> random_terms(std::mt19937_64& rng, poly_shape shape, power max_degree) {
+    std::vector<std::pair<power, coeff>> terms;
+    std::uniform_int_distribution<power> pick_power(0, max_degree);
+    std::uniform_int_distribution<coeff> small(-1000, 1000);
+    std::uniform_int_distribution<coeff> any(INT32_MIN, INT32_MAX);
+
+    if (shape == poly_shape::sparse) {
+        size_t count = 1 + rng() % 60;
+        for (size_t i = 0; i < count; ++i) {
+            terms.emplace_back(pick_power(rng), small(rng));
+        }
+        return terms;
+    }
+
+    for (power p = 0; p <= max_degree; ++p) {
+        // Leave a few holes and explicit zero coefficients in dense inputs.
+        if (rng() % 16 == 0) {
+            continue;
+        }
+        coeff c = shape == poly_shape::huge ? any(rng) : small(rng);
+        if (shape == poly_shape::huge && rng() % 8 == 0) {
+            c = rng() % 2 ? INT32_MAX : INT32_MIN;
+        }
+        terms.emplace_back(p, c);
+    }
+    return terms;
+}
+
+// Compares p against its expected canonical form, and checks that the degree,
+// leading coefficient and term count it tracks agree with it.
+bool matches(const polynomial& p, const std::vector<std::pair<power, coeff>>& expected) {
+    bool is_zero = expected.front().second == 0;
+    return p.canonical_form() == expected &&
+           p.find_degree_of() == expected.front().first &&
+           p.leading_coeff() == expected.front().second &&
+           p.term_count() == (is_zero ? 0 : expected.size());
+}
+
+// p + (-1 * p) must prune every term back to the zero polynomial, and adding
+// a constant that cancels the constant term must drop it.
+bool check_cancellation(const std::vector<std::pair<power, coeff>>& t) {
+    polynomial p(t.begin(), t.end());
+    term_map terms = nonzero_terms(t);
+    coeff constant = terms.count(0) ? terms[0] : 0;
+    terms.erase(0);
+
+    return matches(p + (-1 * p), {std::make_pair(0, 0)}) &&
+           matches(p + static_cast<coeff>(0u - static_cast<uint32_t>(constant)), to_canonical(terms));
+}
+
+bool check_multiply(const std::vector<std::pair<power, coeff>>& t1,
+                    const std::vector<std::pair<power, coeff>>& t2,
+                    double& fast_ms) {
+    polynomial p1(t1.begin(), t1.end());
+    polynomial p2(t2.begin(), t2.end());
+
+    auto begin = std::chrono::steady_clock::now();
+    polynomial product = p1 * p2;
+    auto end = std::chrono::steady_clock::now();
+    fast_ms += std::chrono::duration<double, std::milli>(end - begin).count();
+
+    auto expected = to_canonical(reference_multiply(nonzero_terms(t1), nonzero_terms(t2)));
+    return matches(product, expected);
+}
+
+bool check_mod(const std::vector<std::pair<power, coeff>>& t1,
+               const std::vector<std::pair<power, coeff>>& t2,
+               double& fast_ms) {
+    polynomial p1(t1.begin(), t1.end());
+    polynomial p2(t2.begin(), t2.end());
+
+    auto begin = std::chrono::steady_clock::now();
+    polynomial remainder = p1 % p2;
+    auto end = std::chrono::steady_clock::now();
+    fast_ms += std::chrono::duration<double, std::milli>(end - begin).count();
+
+    auto expected = to_canonical(reference_mod(nonzero_terms(t1), nonzero_terms(t2)));
+    return matches(remainder, expected);
+}
+
+bool check_truncated(const std::vector<std::pair<power, coeff>>& t1,
+                     const std::vector<std::pair<power, coeff>>& t2,
+                     size_t n) {
+    polynomial p1(t1.begin(), t1.end());
+    polynomial p2(t2.begin(), t2.end());
+
+    term_map full = reference_multiply(nonzero_terms(t1), nonzero_terms(t2));
+    term_map low(full.begin(), full.lower_bound(n));
+    term_map high(full.lower_bound(n), full.end());
+
+    return matches(p1.mul_low(p2, n), to_canonical(low)) &&
+           matches(p1.mul_high(p2, n), to_canonical(high));
+}
+
+bool check_square(const std::vector<std::pair<power, coeff>>& t, double& fast_ms) {
+    polynomial p(t.begin(), t.end());
+
+    auto begin = std::chrono::steady_clock::now();
+    polynomial squared = p.square();
+    auto end = std::chrono::steady_clock::now();
+    fast_ms += std::chrono::duration<double, std::milli>(end - begin).count();
+
+    term_map terms = nonzero_terms(t);
+    return matches(squared, to_canonical(reference_multiply(terms, terms)));
+}
+
+// Checks pow(k) against k - 1 reference multiplies, and powmod(k, m) against
+// reducing after each of them. m must be monic so that reducing early or late
+// gives the same remainder.
+bool check_powers(const std::vector<std::pair<power, coeff>>& t,
+                  const std::vector<std::pair<power, coeff>>& m,
+                  size_t k) {
+    polynomial p(t.begin(), t.end());
+    polynomial divisor(m.begin(), m.end());
+
+    term_map base = nonzero_terms(t);
+    term_map modulus = nonzero_terms(m);
+    term_map expected_pow = {{0, 1}};
+    term_map expected_powmod = reference_mod({{0, 1}}, modulus);
+    for (size_t i = 0; i < k; ++i) {
+        expected_pow = reference_multiply(expected_pow, base);
+        expected_powmod = reference_mod(reference_multiply(expected_powmod, base), modulus);
+    }
+
+    return matches(p.pow(k), to_canonical(expected_pow)) &&
+           matches(p.powmod(k, divisor), to_canonical(expected_powmod));
+}
+
+uint64_t reference_pow_mod(uint64_t x, uint64_t k) {
+    uint64_t result = 1;
+    for (; k > 0; k >>= 1, x = x * x % modular::MOD) {
+        if (k & 1) {
+            result = result * x % modular::MOD;
+        }
+    }
+    return result;
+}
+
+// Checks modular evaluation against summing c * x^p term by term, and the
+// floating-point batch kernel against a long double sum.
+bool check_evaluate(const std::vector<std::pair<power, coeff>>& t, std::mt19937_64& rng) {
+    polynomial p(t.begin(), t.end());
+    term_map terms = nonzero_terms(t);
+
+    size_t count = rng() % 4 ? rng() % 16 : 128 + rng() % 256;
+    std::vector<uint32_t> points(count);
+    std::vector<double> real_points(count);
+    for (size_t i = 0; i < count; ++i) {
+        points[i] = rng() % modular::MOD;
+        real_points[i] = std::uniform_real_distribution<double>(-1.0, 1.0)(rng);
+    }
+
+    std::vector<uint32_t> values = p.evaluate_mod(points);
+    std::vector<double> real_values = p.evaluate(real_points);
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t expected = 0;
+        long double real_expected = 0, magnitude = 0;
+        for (const auto& [power_i, c] : terms) {
+            uint64_t residue = (c % static_cast<int64_t>(modular::MOD) + modular::MOD) % modular::MOD;
+            expected = (expected + residue * reference_pow_mod(points[i], power_i)) % modular::MOD;
+            long double term = c * std::pow(static_cast<long double>(real_points[i]), power_i);
+            real_expected += term;
+            magnitude += std::abs(term);
+        }
+        if (values[i] != expected || p.evaluate_mod(points[i]) != expected) {
+            return false;
+        }
+        if (std::abs(real_values[i] - real_expected) > 1e-9 * magnitude + 1e-9 ||
+            std::abs(p.evaluate(real_points[i]) - real_expected) > 1e-9 * magnitude + 1e-9) {
+            return false;
+        }
+    }
+    return true;
+}
+
+using residues = std::vector<uint64_t>;
+
+residues reference_residues(const polynomial& p) {
+    residues r;
+    for (const auto& [power_i, c] : p.canonical_form()) {
+        r.resize(std::max(r.size(), power_i + 1));
+        r[power_i] = (c % static_cast<int64_t>(modular::MOD) + modular::MOD) % modular::MOD;
+    }
+    while (!r.empty() && r.back() == 0) {
+        r.pop_back();
+    }
+    return r;
+}
+
+residues reference_mul_mod(const residues& a, const residues& b) {
+    if (a.empty() || b.empty()) {
+        return {};
+    }
+    residues r(a.size() + b.size() - 1);
+    for (size_t i = 0; i < a.size(); ++i) {
+        for (size_t j = 0; j < b.size(); ++j) {
+            r[i + j] = (r[i + j] + a[i] * b[j]) % modular::MOD;
+        }
+    }
+    while (!r.empty() && r.back() == 0) {
+        r.pop_back();
+    }
+    return r;
+}
+
+// Monic GCD by plain Euclid with schoolbook division.
+residues reference_gcd(residues a, residues b) {
+    while (!b.empty()) {
+        uint64_t lead_inv = reference_pow_mod(b.back(), modular::MOD - 2);
+        while (a.size() >= b.size()) {
+            uint64_t q = a.back() * lead_inv % modular::MOD;
+            size_t shift = a.size() - b.size();
+            for (size_t j = 0; j < b.size(); ++j) {
+                a[shift + j] = (a[shift + j] + (modular::MOD - q) * b[j]) % modular::MOD;
+            }
+            while (!a.empty() && a.back() == 0) {
+                a.pop_back();
+            }
+        }
+        std::swap(a, b);
+    }
+    if (!a.empty()) {
+        uint64_t lead_inv = reference_pow_mod(a.back(), modular::MOD - 2);
+        for (uint64_t& c : a) {
+            c = c * lead_inv % modular::MOD;
+        }
+    }
+    return a;
+}
+
+// Builds a and b with a known common factor, then checks gcd() against Euclid
+// and extended_gcd()'s cofactors against s * a + t * b = g.
+bool check_gcd(std::mt19937_64& rng) {
+    auto factor = random_terms(rng, poly_shape::dense, rng() % 300);
+    auto u = random_terms(rng, rng() % 2 ? poly_shape::dense : poly_shape::sparse, rng() % 500);
+    auto v = random_terms(rng, rng() % 2 ? poly_shape::dense : poly_shape::sparse, rng() % 500);
+    polynomial f(factor.begin(), factor.end());
+    polynomial a = polynomial::from_mod_poly(modular::multiply(f.to_mod_poly(), polynomial(u.begin(), u.end()).to_mod_poly()));
+    polynomial b = polynomial::from_mod_poly(modular::multiply(f.to_mod_poly(), polynomial(v.begin(), v.end()).to_mod_poly()));
+    if (rng() % 8 == 0) {
+        b = a;
+    }
+
+    residues expected = reference_gcd(reference_residues(a), reference_residues(b));
+    polynomial_gcd r = extended_gcd(a, b);
+    residues combined = reference_mul_mod(reference_residues(r.s), reference_residues(a));
+    residues tb = reference_mul_mod(reference_residues(r.t), reference_residues(b));
+    combined.resize(std::max(combined.size(), tb.size()));
+    for (size_t i = 0; i < tb.size(); ++i) {
+        combined[i] = (combined[i] + tb[i]) % modular::MOD;
+    }
+    while (!combined.empty() && combined.back() == 0) {
+        combined.pop_back();
+    }
+
+    return reference_residues(gcd(a, b)) == expected && reference_residues(r.g) == expected && combined == expected;
+}
+
+// Interning equal polynomials must share one node, and the memo cache must
+// hit on a repeated product, miss on new keys and evict least recently used.
+bool check_cache(const std::vector<std::pair<power, coeff>>& t1,
+                 const std::vector<std::pair<power, coeff>>& t2,
+                 const std::vector<std::pair<power, coeff>>& divisor) {
+    polynomial p1(t1.begin(), t1.end());
+    polynomial p2(t2.begin(), t2.end());
+    polynomial d(divisor.begin(), divisor.end());
+    polynomial same(t1.begin(), t1.end());
+    if (p1.hash() != same.hash() || p1 != same) {
+        return false;
+    }
+
+    poly_cache::memo_cache cache(2);
+    poly_cache::handle a = poly_cache::handle::intern(p1);
+    poly_cache::handle a2 = poly_cache::handle::intern(same);
+    poly_cache::handle b = poly_cache::handle::intern(p2);
+    if (a != a2 || &*a != &*a2 || a.hash() != p1.hash()) {
+        return false;
+    }
+
+    poly_cache::handle product = cache.multiply(a, b);
+    bool ok = *product == p1 * p2 && cache.multiply(a2, b) == product &&
+              *cache.mod(a, poly_cache::handle::intern(d)) == p1 % d;
+    cache.multiply(b, a);
+    cache.multiply(a, b);
+
+    poly_cache::cache_stats stats = cache.stats();
+    return ok && stats.hits == 1 && stats.misses == 4 && stats.evictions == 2 && cache.size() == 2;
+}
+
+// Runs parse -> multiply -> modulo -> write as a chain of futures and checks
+// it against the blocking operations; a parse error must reach the end.
+bool check_async(const std::vector<std::pair<power, coeff>>& t1,
+                 const std::vector<std::pair<power, coeff>>& t2,
+                 const std::vector<std::pair<power, coeff>>& divisor) {
+    polynomial p1(t1.begin(), t1.end());
+    polynomial p2(t2.begin(), t2.end());
+    polynomial d(divisor.begin(), divisor.end());
+    std::ostringstream text1, text2, expected;
+    p1.write(text1);
+    p2.write(text2);
+    polynomial product = p1 * p2;
+    (product % d).write(expected);
+
+    auto async_product = poly_async::parse_and_multiply_async(text1.str(), text2.str());
+    auto remainder = poly_async::mod_async(async_product, poly_async::make_ready(d));
+    auto written = poly_async::write_async(remainder);
+
+    auto bad = poly_async::mod_async(poly_async::parse_async("12y^3\n"), poly_async::make_ready(d));
+    bool error_passed_on = false;
+    try {
+        bad.get();
+    }
+    catch (const std::invalid_argument&) {
+        error_passed_on = true;
+    }
+
+    return written.get() == expected.str() && async_product.get() == product && error_passed_on;
+}
+
+// After trim_workspaces() no pool worker holds FFT or NTT memory; the probing
+// tasks themselves do not multiply, so whichever worker runs them must report 0.
+bool check_pool_trim() {
+    poly_async::task_pool &pool = poly_async::task_pool::shared();
+    pool.trim_workspaces();
+    std::vector<poly_async::future<size_t>> held;
+    for (size_t i = 0; i < 2 * pool.size(); ++i) {
+        held.push_back(poly_async::async([] {
+            return fft_workspace::local().bytes_reserved() + modular::ntt_workspace::local().bytes_reserved();
+        }));
+    }
+    for (const auto& h : held) {
+        if (h.get() != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checks multiply_wide against exact schoolbook sums, and multiply_exact on
+// int64 inputs large enough to need four and five CRT primes.
+bool check_wide(const std::vector<std::pair<power, coeff>>& t1,
+                const std::vector<std::pair<power, coeff>>& t2,
+                std::mt19937_64& rng) {
+    polynomial p1(t1.begin(), t1.end());
+    polynomial p2(t2.begin(), t2.end());
+    term_map a = nonzero_terms(t1), b = nonzero_terms(t2);
+    std::vector<std::pair<power, modular::wide_coeff>> expected;
+    if (!a.empty() && !b.empty()) {
+        std::vector<modular::wide_coeff> sums(a.rbegin() -> first + b.rbegin() -> first + 1);
+        for (const auto& [power1, coeff1] : a) {
+            for (const auto& [power2, coeff2] : b) {
+                sums[power1 + power2] += static_cast<int64_t>(coeff1) * coeff2;
+            }
+        }
+        for (size_t p = 0; p < sums.size(); ++p) {
+            if (sums[p] != 0) {
+                expected.emplace_back(p, sums[p]);
+            }
+        }
+    }
+    if (p1.multiply_wide(p2) != expected) {
+        return false;
+    }
+
+    for (auto [length, bits] : {std::make_pair(300, 40), std::make_pair(8, 61)}) {
+        std::vector<int64_t> a(length), b(1 + rng() % length);
+        for (auto& c : a) c = static_cast<int64_t>(rng() >> (64 - bits)) - (int64_t(1) << (bits - 1));
+        for (auto& c : b) c = static_cast<int64_t>(rng() >> (64 - bits)) - (int64_t(1) << (bits - 1));
+        std::vector<modular::wide_coeff> naive(a.size() + b.size() - 1);
+        for (size_t i = 0; i < a.size(); ++i) {
+            for (size_t j = 0; j < b.size(); ++j) {
+                naive[i + j] += static_cast<modular::wide_coeff>(a[i]) * b[j];
+            }
+        }
+        if (modular::multiply_exact(a, b) != naive) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Multiplies through the forked workers with blocks small enough that block
+// products overlap, and checks the overlap-add against operator*.
+bool check_sharded(poly_shard::coordinator& workers,
+                   const std::vector<std::pair<power, coeff>>& t1,
+                   const std::vector<std::pair<power, coeff>>& t2,
+                   size_t block_size) {
+    polynomial p1(t1.begin(), t1.end());
+    polynomial p2(t2.begin(), t2.end());
+    return workers.multiply(p1, p2, block_size) == p1 * p2;
+}
+
+// A coordinator with no workers is rejected, and so is forking once the
+// poly_async pool has threads running. A frame header claiming more than
+// MAX_FRAME bytes is refused before anything is allocated.
+bool check_shard_misuse() {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+        return false;
+    }
+    const char huge_header[8] = {0, 0, 0, 0, 0, 0, 0, 0x40};
+    bool oversized_refused = false;
+    std::string payload;
+    if (write(pair[0], huge_header, sizeof(huge_header)) == sizeof(huge_header)) {
+        try {
+            poly_shard::read_frame(pair[1], payload);
+        }
+        catch (const std::length_error &) {
+            oversized_refused = true;
+        }
+    }
+    close(pair[0]);
+    close(pair[1]);
+    if (!oversized_refused) {
+        return false;
+    }
+
+    poly_async::task_pool::shared();
+    try {
+        poly_shard::coordinator::connect({});
+        return false;
+    }
+    catch (const std::invalid_argument &) {}
+    try {
+        poly_shard::coordinator::spawn(1);
+        return false;
+    }
+    catch (const std::logic_error &) {}
+    return true;
+}
+
+// (x + 1)(x - 1) = x^2 - 1 and its remainders, worked out by the compiler.
+constexpr fixed_polynomial<2> x_plus_1{1, 1};
+constexpr fixed_polynomial<2> x_minus_1{-1, 1};
+static_assert(x_plus_1 * x_minus_1 == fixed_polynomial<3>{-1, 0, 1});
+static_assert((x_plus_1 * x_minus_1 + fixed_polynomial<3>{0, 3}) % x_plus_1 == fixed_polynomial<3>{-3});
+static_assert((x_plus_1 * x_plus_1).evaluate(3) == 16);
+
+// Checks fixed_polynomial against polynomial on random operands of degree
+// at most 8, whose products stay within degree 16.
+bool check_fixed(std::mt19937_64& rng) {
+    fixed_polynomial<9> a, b;
+    for (size_t i = 0; i < 9; ++i) {
+        a[i] = rng() % 3 ? static_cast<coeff>(rng()) : 0;
+        b[i] = rng() % 3 ? static_cast<coeff>(rng() % 21) - 10 : 0;
+    }
+    if (rng() % 2) {
+        b[b.degree()] = rng() % 2 ? 1 : -1;
+    }
+    polynomial pa = a.to_polynomial();
+    polynomial pb = b.to_polynomial();
+
+    uint32_t x = static_cast<uint32_t>(rng());
+    uint32_t expected_value = 0;
+    for (size_t i = 9; i-- > 0; ) {
+        expected_value = expected_value * x + static_cast<uint32_t>(a[i]);
+    }
+
+    return fixed_polynomial<9>::from(pa) == a &&
+           (a * b).to_polynomial() == pa * pb &&
+           (a + b).to_polynomial() == pa + pb &&
+           (a % b).to_polynomial() == pa % pb &&
+           static_cast<uint32_t>(a.evaluate(static_cast<coeff>(x))) == expected_value;
+}
+
+// Interpolates a random polynomial from its values at distinct points and
+// checks that it comes back unchanged.
+bool check_interpolate(std::mt19937_64& rng) {
+    auto t = random_terms(rng, rng() % 2 ? poly_shape::dense : poly_shape::sparse, rng() % 600);
+    polynomial p(t.begin(), t.end());
+    residues expected = reference_residues(p);
+
+    size_t count = std::max<size_t>(expected.size(), 1) + rng() % 8;
+    std::vector<uint32_t> points(count), values(count);
+    for (size_t i = 0; i < count; ++i) {
+        points[i] = static_cast<uint32_t>((rng() % 1000) * count + i);
+        values[i] = p.evaluate_mod(points[i]);
+    }
+
+    return reference_residues(polynomial::interpolate(points, values)) == expected;
+}
+
+// The coefficients of p summed modulo 2^32, ie. p(1) as coeff arithmetic
+// wraps.
+uint32_t coeff_sum(const polynomial& p) {
+    uint32_t sum = 0;
+    p.for_each_term([&](power, coeff c) { sum += static_cast<uint32_t>(c); });
+    return sum;
+}
+
+// Multiplies dense operands of exactly length1 and length2 terms, far beyond
+// the differential test's degrees, and checks the one invariant that stays
+// cheap at this size: the product's coefficient sum is the product of theirs.
+// Squaring goes through its own path and is checked the same way.
+bool check_large_product(std::mt19937_64& rng, poly_shape shape, size_t length1, size_t length2) {
+    auto exact_length = [&](size_t length) {
+        auto t = random_terms(rng, shape, length - 1);
+        if (t.back().first != length - 1 || t.back().second == 0) {
+            t.emplace_back(length - 1, 1);
+        }
+        return polynomial(t.begin(), t.end());
+    };
+    polynomial p1 = exact_length(length1);
+    polynomial p2 = exact_length(length2);
+    uint32_t s1 = coeff_sum(p1), s2 = coeff_sum(p2);
+    return coeff_sum(p1 * p2) == s1 * s2 && coeff_sum(p1 * p1) == s1 * s1;
+}
+
+// Runs check_large_product with product lengths on either side of power of
+// two transform sizes. The long run adds lengths at 2^23, where the first CRT
+// prime runs out of roots of unity and the product is taken in blocks.
+bool large_product_test(uint64_t seed, bool long_run) {
+    std::mt19937_64 rng(seed);
+    std::vector<size_t> boundaries = {size_t(1) << 16, size_t(1) << 17};
+    if (long_run) {
+        boundaries.push_back(size_t(1) << 23);
+    }
+    size_t failures = 0;
+    for (size_t n : boundaries) {
+        for (poly_shape shape : {poly_shape::dense, poly_shape::huge}) {
+            // Product lengths n - 1, n and n + 1.
+            for (size_t extra = 0; extra < 3; ++extra) {
+                if (!check_large_product(rng, shape, n / 2, n / 2 + extra)) {
+                    std::cout << "Large product mismatch: seed " << seed << ", product length "
+                              << n + extra - 1 << std::endl;
+                    failures++;
+                }
+            }
+        }
+    }
+    std::cout << "Large product test: " << boundaries.size() << " sizes, " << failures << " failures" << std::endl;
+    return failures == 0;
+}
+
+bool differential_test(uint64_t seed, size_t rounds) {
+    std::mt19937_64 rng(seed);
+    const poly_shape shapes[] = {poly_shape::sparse, poly_shape::dense, poly_shape::huge};
+    size_t failures = 0;
+    double mul_ms = 0, mod_ms = 0, square_ms = 0;
+    poly_memory::arena arena;
+    // Workers are forked while the process is single threaded, before the
+    // async checks start the poly_async pool.
+    poly_shard::coordinator workers = poly_shard::coordinator::spawn(2);
+
+    for (size_t round = 0; round < rounds; ++round) {
+        // Odd rounds take every polynomial from an arena released per round.
+        poly_memory::memory_scope scope(round % 2 ? &arena : nullptr);
+        poly_shape s1 = shapes[rng() % 3];
+        poly_shape s2 = shapes[rng() % 3];
+        power d1 = s1 == poly_shape::sparse ? rng() % 100000 : 100 + rng() % 3000;
+        power d2 = s2 == poly_shape::sparse ? rng() % 100000 : 100 + rng() % 3000;
+        auto t1 = random_terms(rng, s1, d1);
+        auto t2 = random_terms(rng, s2, d2);
+
+        if (!check_multiply(t1, t2, mul_ms)) {
+            std::cout << "Multiply mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        // Divisors are small so the long division runs to completion; a unit
+        // leading coefficient guarantees every step divides evenly.
+        auto divisor = random_terms(rng, poly_shape::sparse, 1 + rng() % 50);
+        if (rng() % 2) {
+            divisor.emplace_back(100, rng() % 2 ? 1 : -1);
+        }
+        if (!check_mod(t1, divisor, mod_ms)) {
+            std::cout << "Modulo mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+        if (!check_truncated(t1, t2, rng() % (d1 + d2 + 2))) {
+            std::cout << "Truncated product mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        if (!check_square(t1, square_ms)) {
+            std::cout << "Square mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        if (!check_cancellation(t1)) {
+            std::cout << "Cancellation mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        if (!check_evaluate(t1, rng)) {
+            std::cout << "Evaluation mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        if (round % 4 == 0 && !check_gcd(rng)) {
+            std::cout << "GCD mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        if (round % 4 == 3 && !check_cache(t1, t2, divisor)) {
+            std::cout << "Cache mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        if (round % 4 == 2 && !check_async(t1, t2, divisor)) {
+            std::cout << "Async mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        if (round % 4 == 0 && !check_wide(t1, t2, rng)) {
+            std::cout << "Wide product mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        if (round % 4 == 1 && !check_sharded(workers, t1, t2, 1 + std::max(d1, d2) / 3)) {
+            std::cout << "Sharded product mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        if (!check_fixed(rng)) {
+            std::cout << "Fixed polynomial mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        if (round % 4 == 1 && !check_interpolate(rng)) {
+            std::cout << "Interpolation mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+
+        auto base = random_terms(rng, shapes[rng() % 3], rng() % 400);
+        // Odd rounds use a dense modulus with leading coefficient +-1, which
+        // powmod reduces through a precomputed inverse instead of long division.
+        auto monic = round % 2 ? random_terms(rng, rng() % 2 ? poly_shape::dense : poly_shape::huge, 120 + rng() % 30)
+                               : random_terms(rng, poly_shape::sparse, 1 + rng() % 100);
+        monic.emplace_back(150 + rng() % 50, round % 2 && rng() % 2 ? -1 : 1);
+        if (!check_powers(base, monic, rng() % 6)) {
+            std::cout << "Power mismatch: seed " << seed << ", round " << round << std::endl;
+            failures++;
+        }
+        arena.release();
+        if (round % 20 == 19) {
+            fft_workspace::local().trim();
+            modular::ntt_workspace::local().trim();
+            if (!check_pool_trim()) {
+                std::cout << "Pool workspace not trimmed: seed " << seed << ", round " << round << std::endl;
+                failures++;
+            }
+        }
+    }
+    if (!check_shard_misuse()) {
+        std::cout << "Shard misuse accepted: seed " << seed << std::endl;
+        failures++;
+    }
+
+    std::cout << "Differential test: " << rounds << " rounds, " << failures << " failures, "
+              << "multiply " << mul_ms / rounds << " ms/op, "
+              << "modulo " << mod_ms / rounds << " ms/op, "
+              << "square " << square_ms / rounds << " ms/op" << std::endl;
+    return failures == 0;
+}
+
+#ifdef POLY_FUZZ
+// libFuzzer entry point. The first byte selects the operation, the rest is a
+// stream of 6-byte terms (2 bytes power, 4 bytes coeff) split between the two
+// operands by the second byte.
+std::vector<std::pair<power, coeff>> fuzz_terms(const uint8_t* data, size_t size) {
+    std::vector<std::pair<power, coeff>> terms;
+    for (size_t i = 0; i + 6 <= size; i += 6) {
+        power p = data[i] | (data[i + 1] << 8);
+        uint32_t c = data[i + 2] | (data[i + 3] << 8) | (data[i + 4] << 16) | (static_cast<uint32_t>(data[i + 5]) << 24);
+        terms.emplace_back(p, static_cast<coeff>(c));
+    }
+    return terms;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size < 2) {
+        return 0;
+    }
+    size_t split = std::min<size_t>(size - 2, data[1] * 6);
+    auto t1 = fuzz_terms(data + 2, split);
+    auto t2 = fuzz_terms(data + 2 + split, size - 2 - split);
+    double ms = 0;
+
+    bool ok = data[0] % 2 ? check_mod(t1, t2, ms) : check_multiply(t1, t2, ms);
+    if (!ok) {
+        std::abort();
+    }
+    return 0;
+}
+#endif
+
 // void given_test() {
 //     /** We're doing (x+1)^2, so solution is x^2 + 2x + 1*/
 //     std::vector<std::pair<power, coeff>> solution = {{2,1}, {1,2}, {0,1}};
@@ -297,11 +1073,32 @@ void read_txt(std::string input_file, std::string expected_file) {
 
 }
 
-int main()
+#ifndef POLY_FUZZ
+// ./test runs a short differential test; ./test --long runs 200 rounds and
+// multiplies products 2^23 terms long.
+int main(int argc, char** argv)
 {
+    bool long_run = argc > 1 && std::string(argv[1]) == "--long";
+
     // given_test();
     read_txt("simple_poly.txt", "result.txt");
 
+    if (!differential_test(39595, long_run ? 200 : 40)) {
+        return 1;
+    }
+    if (!large_product_test(39595, long_run)) {
+        return 1;
+    }
+
+#ifdef POLY_PROFILE
+    for (const auto& [name, counter] : profile::counters()) {
+        std::cout << name << ": " << counter.calls << " calls, " << counter.total_us / 1000 << " ms, "
+                  << counter.bytes_allocated << " bytes (" << counter.workspace_bytes << " FFT workspace)" << std::endl;
+    }
+    std::ofstream trace("profile_trace.json");
+    profile::dump_chrome_trace(trace);
+#endif
+
     // std::vector<std::pair<power, coeff>> solution = {{2,1}, {1,2}, {0,1}};
     // std::vector<std::pair<power, coeff>> poly_input = {{0, 100}, {1, 5}, {50, 3}};
 
@@ -333,4 +1130,5 @@ int main()
     // }
 
 
-}
\ No newline at end of file
+}
+#endif
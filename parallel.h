@@ -0,0 +1,47 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include "poly_profile.h"
+
+/**
+ * @brief Calls body(begin, end) over contiguous chunks covering [0, count),
+ *        one chunk per hardware thread. Runs inline when count is below
+ *        2 * min_chunk, so small jobs don't pay for thread start-up.
+ *        Under POLY_PROFILE the thread count and the helpers' allocations
+ *        go to the calling thread's current operation.
+ */
+template <typename Body>
+void parallel_for(size_t count, size_t min_chunk, Body body) {
+    size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    threads = std::min(threads, count / std::max<size_t>(1, min_chunk));
+    if (threads <= 1) {
+        if (count > 0) {
+            body(size_t(0), count);
+        }
+        return;
+    }
+
+    POLY_PROFILE_SET_THREADS(threads);
+    size_t chunk = (count + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (size_t begin = chunk; begin < count; begin += chunk) {
+#ifdef POLY_PROFILE
+        workers.emplace_back([&body, counter = profile::allocation_counter()](size_t first, size_t last) {
+            profile::allocation_scope scope(counter);
+            body(first, last);
+        }, begin, std::min(count, begin + chunk));
+#else
+        workers.emplace_back(body, begin, std::min(count, begin + chunk));
+#endif
+    }
+    body(size_t(0), std::min(count, chunk));
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
+#endif
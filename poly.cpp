@@ -1,7 +1,50 @@
 #include "poly.h"
+#include "poly_profile.h"
+#include "parallel.h"
+
+#include <charconv>
+#include <stdexcept>
+#include <string>
+
+// Coefficients wrap modulo 2^32 on overflow, the same as plain int arithmetic
+// on two's complement, but without relying on signed overflow.
+static coeff wrap_add(coeff a, coeff b) {
+    return static_cast<coeff>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+}
+
+static coeff wrap_sub(coeff a, coeff b) {
+    return static_cast<coeff>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b));
+}
+
+static coeff wrap_mul(coeff a, coeff b) {
+    return static_cast<coeff>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+}
+
+static coeff wrap_int64(int64_t v) {
+    return static_cast<coeff>(static_cast<uint32_t>(v));
+}
+
+/**
+ * A divisor's non-zero terms in increasing power order, laid out once so
+ * repeated reductions by the same polynomial skip the map walk. For fast
+ * reduction it also keeps m and the inverse of its reversal to
+ * inverse_length terms; inverse_length is 0 when only long division applies.
+ */
+struct polynomial::divisor
+{
+    std::vector<std::pair<power, coeff>> terms;
+    power degree = 0;
+    coeff leading_coeff = 0;
+    polynomial m;
+    polynomial inverse;
+    size_t inverse_length = 0;
+};
 
 polynomial::polynomial() {
-    coeff_map[0] = 0;
+    degree = 0;
+}
+
+polynomial::polynomial(std::pmr::memory_resource *resource) : coeff_map(resource) {
     degree = 0;
 }
 
@@ -18,13 +61,30 @@ polynomial &polynomial::operator=(const polynomial &other) {
     return *this;
 }
 
+// Like the copy constructor, the new map allocates from the current resource;
+// pmr move assignment only steals other's nodes when that is where they live.
+polynomial::polynomial(polynomial &&other) {
+    coeff_map = std::move(other.coeff_map);
+    degree = other.degree;
+    other.coeff_map.clear();
+    other.degree = 0;
+}
+
+polynomial &polynomial::operator=(polynomial &&other) {
+    if (this != &other) {
+        coeff_map = std::move(other.coeff_map);
+        degree = other.degree;
+        other.coeff_map.clear();
+        other.degree = 0;
+    }
+    return *this;
+}
+
 polynomial polynomial::operator+(const polynomial &other) const {
     polynomial result(other);
-    power max_degree = std::max(degree, other.degree);
-    result.degree = max_degree;
 
     for (const auto& [p, c] : coeff_map) {
-        result.coeff_map[p] += c;
+        result.add_term(p, c);
     }
 
     return result;
@@ -32,7 +92,7 @@ polynomial polynomial::operator+(const polynomial &other) const {
 
 polynomial polynomial::operator+(const int val) const {
     polynomial result(*this);
-    result.coeff_map[0] += val;
+    result.add_term(0, val);
 
     return result;
 }
@@ -43,35 +103,157 @@ polynomial operator+(const int val, const polynomial &other) {
     return temp + val;
 }
 
-void fft(std::vector<std::complex<double>> &a, bool is_invert) {
-    power n = a.size();
-    if (n <= 1) return;
+fft_workspace &fft_workspace::local() {
+    static thread_local fft_workspace workspace;
+    return workspace;
+}
+
+std::vector<std::complex<double>> &fft_workspace::buffer(size_t i, size_t n) {
+    std::vector<std::complex<double>> &buf = buffers.at(i);
+    if (buf.capacity() < n) {
+        POLY_PROFILE_ADD_WORKSPACE_BYTES((n - buf.capacity()) * sizeof(std::complex<double>));
+    }
+    buf.assign(n, 0);
+    return buf;
+}
+
+const std::vector<std::complex<double>> &fft_workspace::roots(size_t n) {
+    if (root_size == 0 || root_size % n != 0) {
+        if (root_table.capacity() < n) {
+            POLY_PROFILE_ADD_WORKSPACE_BYTES((n - root_table.capacity()) * sizeof(std::complex<double>));
+        }
+        root_size = n;
+        root_table.resize(n);
+        for (size_t k = 0; k < n; ++k) {
+            double angle = 2 * PI * k / n;
+            root_table[k] = std::complex<double>(cos(angle), sin(angle));
+        }
+    }
+    return root_table;
+}
+
+size_t fft_workspace::root_table_size() const {
+    return root_size;
+}
+
+void fft_workspace::trim() {
+    for (auto& buf : buffers) {
+        std::vector<std::complex<double>>().swap(buf);
+    }
+    std::vector<std::complex<double>>().swap(root_table);
+    root_size = 0;
+}
+
+size_t fft_workspace::bytes_reserved() const {
+    size_t total = root_table.capacity();
+    for (const auto& buf : buffers) {
+        total += buf.capacity();
+    }
+    return total * sizeof(std::complex<double>);
+}
 
-    std::vector<std::complex<double>> a0(n / 2), a1(n / 2);
-    for (power i = 0; i * 2 < n; i++) {
-        a0[i] = a[i*2];
-        a1[i] = a[i*2 + 1];
+size_t next_fft_size(size_t min_size) {
+    size_t best = 1;
+    while (best < min_size) {
+        best <<= 1;
+    }
+    for (size_t p5 = 1; p5 < best; p5 *= 5) {
+        for (size_t p35 = p5; p35 < best; p35 *= 3) {
+            size_t candidate = p35;
+            while (candidate < min_size) {
+                candidate <<= 1;
+            }
+            best = std::min(best, candidate);
+        }
     }
+    return best;
+}
+
+static size_t fft_radix(size_t len) {
+    if (len % 4 == 0) return 4;
+    if (len % 2 == 0) return 2;
+    if (len % 3 == 0) return 3;
+    return 5;
+}
 
-    fft(a0, is_invert);
-    fft(a1, is_invert);
+void fft(std::complex<double> *a, std::complex<double> *scratch, size_t n, bool is_invert,
+         const std::vector<std::complex<double>> &roots, size_t root_size) {
+    auto root = [&](size_t t) {
+        return is_invert ? std::conj(roots[t]) : roots[t];
+    };
+    // Multiplying by exp(2 pi i / 4) is a quarter turn.
+    auto quarter = [&](std::complex<double> z) {
+        return is_invert ? std::complex<double>(z.imag(), -z.real()) : std::complex<double>(-z.imag(), z.real());
+    };
 
-    for (power i = 0; i * 2 < n; i++) {
-        double dir = is_invert ? -1.0 : 1.0;
-        double angle = (2 * PI * i / n) * dir;
-        std::complex<double> w(cos(angle), sin(angle));
-        a[i] = a0[i] + w * a1[i];
-        a[i + n/2] = a0[i] - w * a1[i];
+    // Stockham autosort: each pass splits the current length by one radix and
+    // ping-pongs between a and scratch, so no bit reversal is needed.
+    std::complex<double> *x = a, *y = scratch;
+    size_t stride = 1;
+    for (size_t len = n; len > 1; ) {
+        size_t r = fft_radix(len);
+        size_t m = len / r;
+        size_t unit = root_size / len;
+        size_t unit_r = root_size / r;
+
+        for (size_t p = 0; p < m; p++) {
+            std::complex<double> w[5];
+            for (size_t k = 0; k < r; k++) {
+                w[k] = root(p * k * unit);
+            }
+            for (size_t q = 0; q < stride; q++) {
+                std::complex<double> v[5];
+                for (size_t j = 0; j < r; j++) {
+                    v[j] = x[q + stride * (p + j * m)];
+                }
+                std::complex<double> *out = y + q + stride * r * p;
+
+                if (r == 2) {
+                    out[0] = v[0] + v[1];
+                    out[stride] = (v[0] - v[1]) * w[1];
+                }
+                else if (r == 4) {
+                    std::complex<double> s02 = v[0] + v[2], d02 = v[0] - v[2];
+                    std::complex<double> s13 = v[1] + v[3], d13 = quarter(v[1] - v[3]);
+                    out[0] = s02 + s13;
+                    out[stride] = (d02 + d13) * w[1];
+                    out[2 * stride] = (s02 - s13) * w[2];
+                    out[3 * stride] = (d02 - d13) * w[3];
+                }
+                else {
+                    for (size_t k = 0; k < r; k++) {
+                        std::complex<double> sum = v[0];
+                        for (size_t j = 1; j < r; j++) {
+                            sum += v[j] * root((j * k % r) * unit_r);
+                        }
+                        out[k * stride] = sum * w[k];
+                    }
+                }
+            }
+        }
+
+        std::swap(x, y);
+        stride *= r;
+        len = m;
     }
 
+    if (x != a) {
+        std::copy(x, x + n, a);
+    }
     if (is_invert) {
-        for (std::complex<double>& x : a) {
-            x /= 2;
+        for (size_t i = 0; i < n; i++) {
+            a[i] /= static_cast<double>(n);
         }
     }
 }
 
-std::vector<std::complex<double>> convert2complex(const std::map<power, coeff> &m, size_t size) {
+void fft(std::vector<std::complex<double>> &a, bool is_invert) {
+    fft_workspace &ws = fft_workspace::local();
+    const auto& roots = ws.roots(a.size());
+    fft(a.data(), ws.buffer(fft_workspace::SCRATCH, a.size()).data(), a.size(), is_invert, roots, ws.root_table_size());
+}
+
+std::vector<std::complex<double>> convert2complex(const coeff_storage &m, size_t size) {
     std::vector<std::complex<double>> vec(size);
     for (const auto& [p, c] : m) {
         vec[p] = std::complex<double>(c, 0);
@@ -86,77 +268,446 @@ bool polynomial::is_sparse(double threshold) const {
     return density < threshold;
 }
 
+// Forward transforms workspace buffers [0, inputs) on their own threads, then
+// accumulates the pointwise products of each listed group into the buffers
+// after the inputs and inverse transforms them.
+static void convolve(fft_workspace &ws, size_t inputs, size_t n,
+                     std::initializer_list<std::initializer_list<std::pair<size_t, size_t>>> products) {
+    POLY_PROFILE_PHASE("forward_fft");
+    POLY_PROFILE_SET_THREADS(inputs);
+    const auto& roots = ws.roots(n);
+    size_t root_size = ws.root_table_size();
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < inputs; ++i) {
+        std::complex<double> *data = ws.buffer(i).data();
+        std::complex<double> *scratch = ws.buffer(fft_workspace::SCRATCH + i, n).data();
+        threads.emplace_back([=, &roots] { fft(data, scratch, n, false, roots, root_size); });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    POLY_PROFILE_PHASE("pointwise");
+    size_t out = inputs;
+    for (const auto& group : products) {
+        std::vector<std::complex<double>> &C = ws.buffer(out++, n);
+        for (const auto& [x, y] : group) {
+            const std::vector<std::complex<double>> &A = ws.buffer(x);
+            const std::vector<std::complex<double>> &B = ws.buffer(y);
+            for (size_t i = 0; i < n; ++i) {
+                C[i] += A[i] * B[i];
+            }
+        }
+    }
+
+    POLY_PROFILE_PHASE("inverse_fft");
+    for (size_t k = inputs; k < out; ++k) {
+        fft(ws.buffer(k).data(), ws.buffer(fft_workspace::SCRATCH).data(), n, true, roots, root_size); // inverse
+    }
+}
+
+namespace {
+
+// The coefficients of a term map as a transform sees them: m itself, or when
+// reversed the coefficients of x^top m(1/x), so index k holds m's power
+// top - k. Walks stop at the first index at or above the limit, which lets a
+// product read just the end of a long operand that it needs.
+struct operand_view
+{
+    const coeff_storage &m;
+    bool reversed = false;
+    power top = 0;
+
+    template <typename F>
+    void for_each(size_t limit, F f) const {
+        if (!reversed) {
+            for (auto i = m.begin(); i != m.end() && i -> first < limit; i++) {
+                f(i -> first, i -> second);
+            }
+        }
+        else {
+            for (auto i = m.rbegin(); i != m.rend() && top - i -> first < limit; i++) {
+                f(top - i -> first, i -> second);
+            }
+        }
+    }
+
+    bool operator==(const operand_view &other) const {
+        return &m == &other.m && reversed == other.reversed && top == other.top;
+    }
+};
+
+// What a product truncated at limit sees of an operand: one past its highest
+// index (0 if none), how many terms, and the largest absolute coefficient.
+struct truncated_operand
+{
+    size_t length = 0;
+    size_t terms = 0;
+    int64_t max_abs = 0;
+};
+
+} // namespace
+
+static truncated_operand truncated(const operand_view &v, size_t limit) {
+    truncated_operand t;
+    v.for_each(limit, [&](size_t k, coeff c) {
+        t.length = k + 1;
+        t.terms++;
+        t.max_abs = std::max(t.max_abs, std::abs(static_cast<int64_t>(c)));
+    });
+    return t;
+}
+
+static void load_coeffs(const operand_view &v, size_t limit, std::vector<std::complex<double>> &vec) {
+    v.for_each(limit, [&](size_t k, coeff c) { vec[k] = std::complex<double>(c, 0); });
+}
+
+static void load_dense(const operand_view &v, size_t limit, std::vector<int64_t> &vec) {
+    v.for_each(limit, [&](size_t k, coeff c) { vec[k] = c; });
+}
+
+// Dense product of a and b through the FFT, keeping only the coefficients
+// below index limit. Terms at or above limit cannot contribute, so they are
+// never read. Passing the same view twice squares it with a single forward
+// transform.
+static coeff_storage fft_product(const operand_view &a, const operand_view &b, size_t limit) {
+    bool squaring = a == b;
+    truncated_operand seen_a = truncated(a, limit);
+    truncated_operand seen_b = truncated(b, limit);
+    size_t length_a = seen_a.length;
+    size_t length_b = seen_b.length;
+    if (length_a == 0 || length_b == 0) {
+        return coeff_storage(poly_memory::current_resource());
+    }
+
+    // The truncated operands have a product of length_a + length_b - 1
+    // coefficients, so any cyclic length at least that long holds it without
+    // wrapping.
+    size_t product_length = length_a + length_b - 1;
+    size_t outputs = std::min(limit, product_length);
+    size_t n = next_fft_size(product_length);
+    POLY_PROFILE_SET_TRANSFORM(n);
+    POLY_PROFILE_PHASE("convert");
+
+    // Doubles hold integers exactly up to 2^53; keep a margin for the rounding
+    // error of the transform. Above the bound, take exact products modulo
+    // several NTT primes instead.
+    double bound = static_cast<double>(seen_a.max_abs) * seen_b.max_abs * std::min(seen_a.terms, seen_b.terms);
+
+    fft_workspace &ws = fft_workspace::local();
+    coeff_storage result_map(poly_memory::current_resource());
+    auto emit = [&](size_t i, int64_t value) {
+        coeff val = wrap_int64(value);
+        if (val != 0) {
+            result_map.emplace_hint(result_map.end(), i, val);
+        }
+    };
+
+    if (bound < FFT_EXACT_BOUND) {
+        POLY_PROFILE_SET_PATH("fft");
+        load_coeffs(a, limit, ws.buffer(0, n));
+        if (squaring) {
+            convolve(ws, 1, n, {{{0, 0}}});
+        }
+        else {
+            load_coeffs(b, limit, ws.buffer(1, n));
+            convolve(ws, 2, n, {{{0, 1}}});
+        }
+
+        POLY_PROFILE_PHASE("rounding");
+        const std::vector<std::complex<double>> &C = ws.buffer(squaring ? 1 : 2);
+        for (size_t i = 0; i < outputs; ++i) {
+            emit(i, std::llround(C[i].real()));
+        }
+    }
+    else if (product_length <= modular::CRT_PRIMES[0].max_length) {
+        // Exact products of int coefficients need three primes; only their
+        // low 32 bits are kept.
+        POLY_PROFILE_SET_PATH("multimodular");
+        std::vector<int64_t> dense_a(length_a), dense_b;
+        load_dense(a, limit, dense_a);
+        if (!squaring) {
+            dense_b.resize(length_b);
+            load_dense(b, limit, dense_b);
+        }
+        POLY_PROFILE_PHASE("crt_products");
+        std::vector<modular::wide_coeff> product = modular::multiply_exact(dense_a, squaring ? dense_a : dense_b);
+
+        POLY_PROFILE_PHASE("rounding");
+        for (size_t i = 0; i < outputs; ++i) {
+            emit(i, static_cast<int64_t>(product[i]));
+        }
+    }
+    else {
+        // Too long for the first prime. Cut both operands into blocks whose
+        // pairwise products fit it and overlap-add the exact block products,
+        // wrapped to 32 bits; each block pair is an ordinary multimodular
+        // product, so any length completes.
+        POLY_PROFILE_SET_PATH("multimodular_blocked");
+        size_t block = modular::CRT_PRIMES[0].max_length / 2;
+        auto cut = [&](const operand_view &v, size_t length) {
+            std::vector<std::vector<int64_t>> blocks;
+            for (size_t first = 0; first < length; first += block) {
+                blocks.emplace_back(std::min(block, length - first));
+            }
+            v.for_each(limit, [&](size_t k, coeff c) { blocks[k / block][k % block] = c; });
+            return blocks;
+        };
+        std::vector<std::vector<int64_t>> blocks_a = cut(a, length_a);
+        std::vector<std::vector<int64_t>> blocks_b = squaring ? std::vector<std::vector<int64_t>>() : cut(b, length_b);
+        const std::vector<std::vector<int64_t>> &right = squaring ? blocks_a : blocks_b;
+
+        POLY_PROFILE_PHASE("crt_products");
+        std::vector<uint32_t> sums(outputs);
+        for (size_t i = 0; i < blocks_a.size(); ++i) {
+            // A square only needs block pairs with i <= j, the others twice.
+            for (size_t j = squaring ? i : 0; j < right.size() && (i + j) * block < outputs; ++j) {
+                std::vector<modular::wide_coeff> product = modular::multiply_exact(blocks_a[i], right[j]);
+                uint32_t scale = squaring && i != j ? 2 : 1;
+                size_t offset = (i + j) * block;
+                for (size_t k = 0; k < product.size() && offset + k < outputs; ++k) {
+                    sums[offset + k] += scale * static_cast<uint32_t>(static_cast<uint64_t>(product[k]));
+                }
+            }
+        }
+
+        POLY_PROFILE_PHASE("rounding");
+        for (size_t i = 0; i < outputs; ++i) {
+            emit(i, sums[i]);
+        }
+    }
+    return result_map;
+}
+
 polynomial polynomial::operator*(const polynomial &other) const {
+    if (this == &other) {
+        return square();
+    }
+
+    POLY_PROFILE_OP("multiply");
+    POLY_PROFILE_SET_SIZES(coeff_map.size(), other.coeff_map.size());
     power sum_deg = degree + other.degree;
 
     if (is_sparse() || other.is_sparse()) {
         // normal mul
+        POLY_PROFILE_SET_PATH("sparse");
         polynomial result;
         for (const auto& [power1, coeff1] : coeff_map) {
             for (const auto& [power2, coeff2] : other.coeff_map) {
                 power new_power = power1 + power2;
-                int new_coeff = coeff1 * coeff2;
+                coeff new_coeff = wrap_mul(coeff1, coeff2);
     
-                result.coeff_map[new_power] += new_coeff;
+                result.add_term(new_power, new_coeff);
             }
         }
-        result.degree = result.coeff_map.rbegin() -> first;
+        POLY_PROFILE_SET_RESULT(result.coeff_map.size());
         return result;
     }
 
     // Start FFT
-    size_t n = 1;
-    while (n <= sum_deg) {
-        n <<= 1;
+    polynomial result;
+    coeff_storage result_map = fft_product({coeff_map}, {other.coeff_map}, sum_deg + 1);
+    result.coeff_map = std::move(result_map);
+    result.update_degree();
+    POLY_PROFILE_SET_RESULT(result.coeff_map.size());
+    return result;
+}
+
+polynomial polynomial::mul_low(const polynomial &other, size_t n) const {
+    POLY_PROFILE_OP("mul_low");
+    POLY_PROFILE_SET_SIZES(coeff_map.size(), other.coeff_map.size());
+    polynomial result;
+
+    if (is_sparse() || other.is_sparse()) {
+        // Both maps are ordered, so stop each inner walk at the first power
+        // that lands on or above n.
+        POLY_PROFILE_SET_PATH("sparse");
+        for (auto i = coeff_map.begin(); i != coeff_map.end() && i -> first < n; i++) {
+            for (auto j = other.coeff_map.begin(); j != other.coeff_map.end() && i -> first + j -> first < n; j++) {
+                power new_power = i -> first + j -> first;
+                result.add_term(new_power, wrap_mul(i -> second, j -> second));
+            }
+        }
+        POLY_PROFILE_SET_RESULT(result.coeff_map.size());
+        return result;
     }
-    n <<= 1;
 
-    std::vector<std::complex<double>> A = convert2complex(coeff_map, n);
-    std::vector<std::complex<double>> B = convert2complex(other.coeff_map, n);
+    coeff_storage result_map = fft_product({coeff_map}, {other.coeff_map}, n);
+    result.coeff_map = std::move(result_map);
+    result.update_degree();
+    POLY_PROFILE_SET_RESULT(result.coeff_map.size());
+    return result;
+}
 
-    std::thread t1(fft, std::ref(A), false);
-    std::thread t2(fft, std::ref(B), false);
-    t1.join();
-    t2.join();
+polynomial polynomial::mul_high(const polynomial &other, size_t n) const {
+    POLY_PROFILE_OP("mul_high");
+    POLY_PROFILE_SET_SIZES(coeff_map.size(), other.coeff_map.size());
+    power sum_deg = degree + other.degree;
+    polynomial result;
+    if (n > sum_deg) {
+        return result;
+    }
 
-    std::vector<std::complex<double>> C(n);
-    for (size_t i = 0; i < n; ++i) {
-        C[i] = A[i] * B[i];
+    if (is_sparse() || other.is_sparse()) {
+        POLY_PROFILE_SET_PATH("sparse");
+        for (const auto& [power1, coeff1] : coeff_map) {
+            auto j = power1 >= n ? other.coeff_map.begin() : other.coeff_map.lower_bound(n - power1);
+            for (; j != other.coeff_map.end(); j++) {
+                power new_power = power1 + j -> first;
+                result.add_term(new_power, wrap_mul(coeff1, j -> second));
+            }
+        }
+        POLY_PROFILE_SET_RESULT(result.coeff_map.size());
+        return result;
     }
 
-    fft(C, true); // inverse
+    // Reversing both operands turns the top of the product into the bottom:
+    // coefficient k of a * b is coefficient sum_deg - k of rev(a) * rev(b).
+    // The reversed views read only each operand's top sum_deg - n + 1 terms.
+    coeff_storage low = fft_product({coeff_map, true, degree}, {other.coeff_map, true, other.degree}, sum_deg - n + 1);
+    result.coeff_map.clear();
+    for (auto i = low.rbegin(); i != low.rend(); i++) {
+        result.coeff_map.emplace_hint(result.coeff_map.end(), sum_deg - i -> first, i -> second);
+    }
+    result.update_degree();
+    POLY_PROFILE_SET_RESULT(result.coeff_map.size());
+    return result;
+}
 
-    std::map<power, coeff> result_map;
+std::vector<std::pair<power, modular::wide_coeff>> polynomial::multiply_wide(const polynomial &other) const {
+    POLY_PROFILE_OP("multiply_wide");
+    POLY_PROFILE_SET_SIZES(coeff_map.size(), other.coeff_map.size());
+    std::vector<std::pair<power, modular::wide_coeff>> result;
+    if (coeff_map.empty() || other.coeff_map.empty()) {
+        return result;
+    }
 
-    for (size_t i = 0; i <= sum_deg; ++i) {
-        // int val = std::round(C[i].real());
-        // int val = (std::abs(C[i].real()) < 1e-3) ? 0 : std::round(C[i].real());
-        double d_val = static_cast<int64_t>(std::round(C[i].real()));
-        int val;
-        if (d_val > 2147483647 || d_val < -2147483647) {
-            val = static_cast<int32_t>(d_val);
+    if (is_sparse() || other.is_sparse()) {
+        POLY_PROFILE_SET_PATH("sparse");
+        std::map<power, modular::wide_coeff> sums;
+        for (const auto& [power1, coeff1] : coeff_map) {
+            for (const auto& [power2, coeff2] : other.coeff_map) {
+                sums[power1 + power2] += static_cast<int64_t>(coeff1) * coeff2;
+            }
         }
-        else {
-            val = static_cast<coeff>(d_val);
+        for (const auto& [p, c] : sums) {
+            if (c != 0) {
+                result.emplace_back(p, c);
+            }
         }
+        POLY_PROFILE_SET_RESULT(result.size());
+        return result;
+    }
 
-        if (val != 0) {
-            result_map[i] = val;
+    POLY_PROFILE_SET_PATH("multimodular");
+    POLY_PROFILE_PHASE("convert");
+    std::vector<int64_t> a(degree + 1), b(other.degree + 1);
+    for (const auto& [p, c] : coeff_map) {
+        a[p] = c;
+    }
+    for (const auto& [p, c] : other.coeff_map) {
+        b[p] = c;
+    }
+    POLY_PROFILE_PHASE("crt_products");
+    std::vector<modular::wide_coeff> product = modular::multiply_exact(a, b);
+    for (size_t i = 0; i < product.size(); i++) {
+        if (product[i] != 0) {
+            result.emplace_back(i, product[i]);
         }
     }
+    POLY_PROFILE_SET_RESULT(result.size());
+    return result;
+}
+
+polynomial polynomial::square() const {
+    POLY_PROFILE_OP("square");
+    POLY_PROFILE_SET_SIZES(coeff_map.size(), coeff_map.size());
+
+    if (is_sparse()) {
+        // Each cross term appears twice, so only walk pairs with power1 <= power2.
+        POLY_PROFILE_SET_PATH("sparse");
+        polynomial result;
+        for (auto i = coeff_map.begin(); i != coeff_map.end(); i++) {
+            result.add_term(2 * i -> first, wrap_mul(i -> second, i -> second));
+            coeff twice = wrap_add(i -> second, i -> second);
+            for (auto j = std::next(i); j != coeff_map.end(); j++) {
+                power new_power = i -> first + j -> first;
+                result.add_term(new_power, wrap_mul(twice, j -> second));
+            }
+        }
+        POLY_PROFILE_SET_RESULT(result.coeff_map.size());
+        return result;
+    }
 
     polynomial result;
+    coeff_storage result_map = fft_product({coeff_map}, {coeff_map}, 2 * degree + 1);
     result.coeff_map = std::move(result_map);
-    result.degree = result.coeff_map.rbegin() -> first;
+    result.update_degree();
+    POLY_PROFILE_SET_RESULT(result.coeff_map.size());
+    return result;
+}
+
+polynomial polynomial::pow(size_t k) const {
+    POLY_PROFILE_OP("pow");
+    std::vector<std::pair<power, coeff>> one = {{0, 1}};
+    if (k == 0) {
+        return polynomial(one.begin(), one.end());
+    }
+
+    // Left-to-right binary exponentiation, starting after the top bit.
+    size_t bit = 1;
+    while (bit <= k / 2) {
+        bit <<= 1;
+    }
+    polynomial result(*this);
+    for (bit >>= 1; bit > 0; bit >>= 1) {
+        result = result.square();
+        if (k & bit) {
+            result = result * *this;
+        }
+    }
+    return result;
+}
+
+polynomial polynomial::powmod(size_t k, const polynomial &m) const {
+    POLY_PROFILE_OP("powmod");
+    // Reduced operands have degree below m's, so their squares and products
+    // have quotients shorter than m's degree; only the base may need more.
+    power m_degree = m.degree;
+    size_t quotient_length = std::max<size_t>(m_degree, degree >= m_degree ? degree - m_degree + 1 : 0);
+    divisor d = prepare_divisor(m, quotient_length);
+
+    polynomial base(*this);
+    base.reduce(d);
+
+    std::vector<std::pair<power, coeff>> one = {{0, 1}};
+    polynomial result(one.begin(), one.end());
+    result.reduce(d);
+
+    size_t bit = 1;
+    while (bit <= k / 2) {
+        bit <<= 1;
+    }
+    for (; k > 0 && bit > 0; bit >>= 1) {
+        result = result.square();
+        result.reduce(d);
+        if (k & bit) {
+            result = result * base;
+            result.reduce(d);
+        }
+    }
     return result;
 }
 
 polynomial polynomial::operator*(const int val) const {
     polynomial result(*this);
 
-    for (auto& [p, c] : result.coeff_map) {
-        result.coeff_map[p] *= val;
+    for (auto i = result.coeff_map.begin(); i != result.coeff_map.end();) {
+        i -> second = wrap_mul(i -> second, val);
+        i = i -> second == 0 ? result.coeff_map.erase(i) : std::next(i);
     }
+    result.update_degree();
 
     return result;
 }
@@ -166,71 +717,283 @@ polynomial operator*(const int val, const polynomial &other) {
     return temp * val;
 }
 
-polynomial polynomial::operator%(const polynomial &other) const {
-    if (other.degree > degree) {
-        return *this;
+polynomial::divisor polynomial::prepare_divisor(const polynomial &other, size_t quotient_length) {
+    divisor d;
+    for (const auto& [p, c] : other.coeff_map) {
+        if (c != 0) {
+            d.terms.emplace_back(p, c);
+        }
     }
-    
-    if (other.coeff_map.empty() || (other.coeff_map.size() == 1 && other.coeff_map.at(0) == 0)) {
+    if (!d.terms.empty()) {
+        std::tie(d.degree, d.leading_coeff) = d.terms.back();
+    }
+    if (quotient_length == 0 || (d.leading_coeff != 1 && d.leading_coeff != -1) || other.is_sparse()) {
+        return d;
+    }
+
+    // rev(m) = x^degree m(1/x) has constant term +-1, its own inverse, so
+    // Newton's iteration g <- g (2 - rev(m) g) doubles the precision of its
+    // inverse each step. Every step is exact in wrapping coeff arithmetic.
+    d.m = other;
+    std::vector<std::pair<power, coeff>> reversed;
+    for (auto i = other.coeff_map.rbegin(); i != other.coeff_map.rend(); i++) {
+        reversed.emplace_back(d.degree - i -> first, i -> second);
+    }
+    polynomial rev_m(reversed.begin(), reversed.end());
+    std::vector<std::pair<power, coeff>> constant = {{0, d.leading_coeff}};
+    polynomial inverse(constant.begin(), constant.end());
+    for (size_t n = 1; n < quotient_length; ) {
+        n = std::min(2 * n, quotient_length);
+        polynomial correction = rev_m.mul_low(inverse, n) * -1 + 2;
+        inverse = inverse.mul_low(correction, n);
+    }
+    d.inverse = std::move(inverse);
+    d.inverse_length = quotient_length;
+    return d;
+}
+
+void polynomial::reduce(const divisor &d) {
+    if (d.leading_coeff == 0) {
+        return;
+    }
+    if (!coeff_map.empty() && degree >= d.degree && degree - d.degree < d.inverse_length) {
+        // With q the quotient and n = deg m, rev(q) is the first
+        // deg f - n + 1 terms of rev(f) / rev(m), which only reads f's top
+        // terms; the remainder f - q m then lies entirely below x^n.
+        POLY_PROFILE_SET_PATH("inverse");
+        size_t quotient_length = degree - d.degree + 1;
+        std::vector<std::pair<power, coeff>> top;
+        for (auto i = coeff_map.rbegin(); i != coeff_map.rend() && i -> first >= d.degree; i++) {
+            top.emplace_back(degree - i -> first, i -> second);
+        }
+        polynomial reversed_quotient = polynomial(top.begin(), top.end()).mul_low(d.inverse, quotient_length);
+        std::vector<std::pair<power, coeff>> quotient;
+        reversed_quotient.for_each_term([&](power p, coeff c) {
+            quotient.emplace_back(quotient_length - 1 - p, c);
+        });
+        polynomial subtracted = polynomial(quotient.begin(), quotient.end()).mul_low(d.m, d.degree);
+
+        coeff_map.erase(coeff_map.lower_bound(d.degree), coeff_map.end());
+        update_degree();
+        subtracted.for_each_term([&](power p, coeff c) { add_term(p, wrap_sub(0, c)); });
+        return;
+    }
+    power divisor_degree = d.degree;
+    coeff divisor_leading_coeff = d.leading_coeff;
+
+    while (!coeff_map.empty() && degree >= divisor_degree) {
+        power quotient_power = degree - divisor_degree;
+        // Divide in 64 bits so INT_MIN / -1 wraps instead of trapping.
+        int64_t remainder_lc = leading_coeff();
+        if (remainder_lc % divisor_leading_coeff != 0) {
+            break;
+        }
+        coeff quotient_coeff = wrap_int64(remainder_lc / divisor_leading_coeff);
+
+        for (const auto& [p, c] : d.terms) {
+            add_term(p + quotient_power, wrap_mul(wrap_sub(0, c), quotient_coeff));
+        }
+    }
+}
+
+polynomial polynomial::operator%(const polynomial &other) const {
+    POLY_PROFILE_OP("modulo");
+    POLY_PROFILE_SET_SIZES(coeff_map.size(), other.coeff_map.size());
+    POLY_PROFILE_SET_PATH("long_division");
+    divisor d = prepare_divisor(other);
+    if (d.leading_coeff == 0 || coeff_map.empty() || d.degree > degree) {
         return *this;
     }
     
     polynomial result(*this);
-    power divisor_degree = other.degree;
-    coeff divisor_leading_coeff = 0;
-    
-    for (const auto& [p, c] : other.coeff_map) {
-        if (p == divisor_degree) {
-            divisor_leading_coeff = c;
-            break;
+    result.reduce(d);
+    POLY_PROFILE_SET_RESULT(result.coeff_map.size());
+    return result;
+}
+
+static double power_of(double x, size_t k) {
+    double result = 1;
+    while (k > 0) {
+        if (k & 1) {
+            result *= x;
         }
+        x *= x;
+        k >>= 1;
     }
+    return result;
+}
+
+double polynomial::evaluate(double x) const {
+    double result = 0;
+    power previous = degree;
+    for (auto i = coeff_map.rbegin(); i != coeff_map.rend(); i++) {
+        result = result * power_of(x, previous - i -> first) + i -> second;
+        previous = i -> first;
+    }
+    return result * power_of(x, previous);
+}
+
+// Points evaluated together by the dense kernel; the accumulators fit in a
+// few vector registers.
+static const size_t EVAL_BLOCK = 16;
+
+std::vector<double> polynomial::evaluate(const std::vector<double> &xs) const {
+    POLY_PROFILE_OP("evaluate");
+    POLY_PROFILE_SET_SIZES(coeff_map.size(), xs.size());
+    std::vector<double> values(xs.size());
 
-    while (!result.coeff_map.empty() && result.degree >= divisor_degree) {
-        power remainder_degree = result.degree;
-        coeff remainder_leading_coeff = 0;
-        
-        for (const auto& [p, c] : result.coeff_map) {
-            if (p == remainder_degree) {
-                remainder_leading_coeff = c;
-                break;
+    if (is_sparse()) {
+        POLY_PROFILE_SET_PATH("sparse");
+        parallel_for(xs.size(), 1024, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                values[i] = evaluate(xs[i]);
             }
-        }
-        if (remainder_leading_coeff == 0) {
-            result.coeff_map.erase(remainder_degree);
-            result.degree = 0;
-            for (const auto& [p, c] : result.coeff_map) {
-                if (p > result.degree) {
-                    result.degree = p;
+        });
+        return values;
+    }
+
+    POLY_PROFILE_SET_PATH("dense_horner");
+    std::vector<double> dense(degree + 1);
+    for (const auto& [p, c] : coeff_map) {
+        dense[p] = c;
+    }
+
+    size_t blocks = (xs.size() + EVAL_BLOCK - 1) / EVAL_BLOCK;
+    parallel_for(blocks, std::max<size_t>(1, 65536 / dense.size()), [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; block++) {
+            size_t first = block * EVAL_BLOCK;
+            size_t count = std::min(EVAL_BLOCK, xs.size() - first);
+            double x[EVAL_BLOCK] = {};
+            double acc[EVAL_BLOCK] = {};
+            std::copy(xs.begin() + first, xs.begin() + first + count, x);
+
+            for (size_t k = dense.size(); k-- > 0; ) {
+                double c = dense[k];
+                for (size_t j = 0; j < EVAL_BLOCK; j++) {
+                    acc[j] = acc[j] * x[j] + c;
                 }
             }
-            continue;
+            std::copy(acc, acc + count, values.begin() + first);
+        }
+    });
+    return values;
+}
+
+uint32_t polynomial::evaluate_mod(uint32_t x) const {
+    x %= modular::MOD;
+    uint32_t result = 0;
+    power previous = degree;
+    for (auto i = coeff_map.rbegin(); i != coeff_map.rend(); i++) {
+        result = modular::mul(result, modular::pow_mod(x, previous - i -> first));
+        result = modular::add(result, modular::reduce(i -> second));
+        previous = i -> first;
+    }
+    return modular::mul(result, modular::pow_mod(x, previous));
+}
+
+std::vector<uint32_t> polynomial::evaluate_mod(const std::vector<uint32_t> &xs) const {
+    POLY_PROFILE_OP("evaluate_mod");
+    POLY_PROFILE_SET_SIZES(coeff_map.size(), xs.size());
+
+    if (is_sparse()) {
+        POLY_PROFILE_SET_PATH("sparse");
+        std::vector<uint32_t> values(xs.size());
+        parallel_for(xs.size(), 1024, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                values[i] = evaluate_mod(xs[i]);
+            }
+        });
+        return values;
+    }
+
+    POLY_PROFILE_SET_PATH("multipoint");
+    std::vector<uint32_t> points(xs.size());
+    for (size_t i = 0; i < xs.size(); i++) {
+        points[i] = xs[i] % modular::MOD;
+    }
+    return modular::evaluate(to_mod_poly(), points);
+}
+
+modular::mod_poly polynomial::to_mod_poly() const {
+    modular::mod_poly result(degree + 1);
+    for (const auto& [p, c] : coeff_map) {
+        result[p] = modular::reduce(c);
+    }
+    modular::trim(result);
+    return result;
+}
+
+polynomial polynomial::from_mod_poly(const modular::mod_poly &a) {
+    std::vector<std::pair<power, coeff>> terms;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i] != 0) {
+            terms.emplace_back(i, static_cast<coeff>(a[i]));
         }
-        power quotient_power = remainder_degree - divisor_degree;
-        coeff quotient_coeff = remainder_leading_coeff / divisor_leading_coeff;
-        
-        if (remainder_leading_coeff % divisor_leading_coeff != 0) {
+    }
+    if (terms.empty()) {
+        return polynomial();
+    }
+    return polynomial(terms.begin(), terms.end());
+}
+
+polynomial polynomial::interpolate(const std::vector<uint32_t> &points, const std::vector<uint32_t> &values) {
+    POLY_PROFILE_OP("interpolate");
+    POLY_PROFILE_SET_SIZES(points.size(), values.size());
+    return from_mod_poly(modular::interpolate(points, values));
+}
+
+polynomial polynomial::parse(std::istream &in) {
+    polynomial result;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line == ";") {
             break;
         }
-        for (const auto& [p, c] : other.coeff_map) {
-            result.coeff_map[p + quotient_power] -= c * quotient_coeff;
-            
-            if (result.coeff_map[p + quotient_power] == 0) {
-                result.coeff_map.erase(p + quotient_power);
-            }
+        if (line.empty()) {
+            continue;
         }
-        
-        result.degree = 0;
-        for (const auto& [p, c] : result.coeff_map) {
-            if (p > result.degree) {
-                result.degree = p;
-            }
+
+        // Coefficients wrap like every other coeff arithmetic here.
+        size_t split_idx = line.find("x^");
+        const char *end = line.data() + line.size();
+        int64_t c = 0;
+        power p = 0;
+        bool ok = split_idx != std::string::npos && split_idx > 0;
+        if (ok) {
+            auto [c_end, c_err] = std::from_chars(line.data(), line.data() + split_idx, c);
+            auto [p_end, p_err] = std::from_chars(line.data() + split_idx + 2, end, p);
+            ok = c_err == std::errc() && c_end == line.data() + split_idx &&
+                 p_err == std::errc() && p_end == end && split_idx + 2 < line.size();
+        }
+        if (!ok) {
+            throw std::invalid_argument("polynomial::parse: malformed term \"" + line + "\"");
         }
+        result.add_term(p, wrap_int64(c));
     }
-    
     return result;
 }
 
+void polynomial::write(std::ostream &out) const {
+    for (const auto& [p, c] : canonical_form()) {
+        out << c << "x^" << p << '\n';
+    }
+    out << ";\n";
+}
+
+polynomial gcd(const polynomial &a, const polynomial &b) {
+    POLY_PROFILE_OP("gcd");
+    return polynomial::from_mod_poly(modular::gcd(a.to_mod_poly(), b.to_mod_poly()));
+}
+
+polynomial_gcd extended_gcd(const polynomial &a, const polynomial &b) {
+    POLY_PROFILE_OP("extended_gcd");
+    modular::gcd_result r = modular::extended_gcd(a.to_mod_poly(), b.to_mod_poly());
+    return {polynomial::from_mod_poly(r.g), polynomial::from_mod_poly(r.s), polynomial::from_mod_poly(r.t)};
+}
+
 void polynomial::print() const {
     std::cout << "Degree: " << degree << std::endl;
     for (const auto& [p, c] : coeff_map) {
@@ -245,18 +1008,38 @@ void polynomial::print() const {
     std::cout << std::endl << std::endl;
 }
 
-size_t polynomial::find_degree_of() {
-    for (auto i = coeff_map.rbegin(); i != coeff_map.rend(); i++) {
-        power p = i -> first;
-        coeff c = i -> second;
+std::pmr::memory_resource *polynomial::resource() const {
+    return coeff_map.get_allocator().resource();
+}
 
-        if (c != 0) {
-            degree = p;
-            break;
+size_t polynomial::find_degree_of() const {
+    return degree;
+}
+
+coeff polynomial::leading_coeff() const {
+    return coeff_map.empty() ? 0 : coeff_map.rbegin() -> second;
+}
+
+size_t polynomial::term_count() const {
+    return coeff_map.size();
+}
+
+void polynomial::add_term(power p, coeff c) {
+    if (c == 0) {
+        return;
+    }
+    auto [i, inserted] = coeff_map.try_emplace(p, c);
+    if (!inserted) {
+        i -> second = wrap_add(i -> second, c);
+        if (i -> second == 0) {
+            coeff_map.erase(i);
         }
     }
-    // degree = coeff_map.rbegin() -> first;
-    return degree;
+    update_degree();
+}
+
+void polynomial::update_degree() {
+    degree = coeff_map.empty() ? 0 : coeff_map.rbegin() -> first;
 }
 
 std::vector<std::pair<power, coeff>> polynomial::canonical_form() const {
@@ -276,3 +1059,31 @@ std::vector<std::pair<power, coeff>> polynomial::canonical_form() const {
 
     return result;
 }
+
+static uint64_t mix(uint64_t h, uint64_t v) {
+    // splitmix64 finalizer over the running hash and the next word
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+size_t polynomial::hash() const {
+    // Zero terms are never stored, so equal polynomials walk the same terms.
+    uint64_t h = coeff_map.size();
+    for (const auto& [p, c] : coeff_map) {
+        h = mix(h, p);
+        h = mix(h, static_cast<uint32_t>(c));
+    }
+    return static_cast<size_t>(h);
+}
+
+bool polynomial::operator==(const polynomial &other) const {
+    return degree == other.degree && coeff_map == other.coeff_map;
+}
+
+bool polynomial::operator!=(const polynomial &other) const {
+    return !(*this == other);
+}
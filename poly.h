@@ -4,32 +4,66 @@
 #include <vector>
 #include <map>
 #include <utility>
+#include <tuple>
 #include <cstddef>
 #include <iostream>
 #include <thread>
 #include <mutex>
 #include <cmath>
 #include <complex>
+#include <array>
+#include <memory_resource>
+#include "poly_memory.h"
+#include "poly_mod.h"
 
 using power = size_t;
 using coeff = int;
+using coeff_storage = std::pmr::map<power, coeff>;
 
 const size_t NUM_THREADS = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
 const double PI = acos(-1);
+const double FFT_EXACT_BOUND = 1e14;
 
 class polynomial
 {
 private:
-    std::map<power, coeff> coeff_map;
+    coeff_storage coeff_map{poly_memory::current_resource()};
     power degree = 0;
 
     void multiply_range(const polynomial& other, 
-                       std::map<power, coeff>& result_map,
+                       coeff_storage& result_map,
                        std::mutex& result_mutex,
                        size_t start, 
                        size_t end,
                        const std::vector<std::pair<power, coeff>>& coeffs1) const;
 
+    // A divisor prepared for repeated reductions, defined in poly.cpp.
+    struct divisor;
+
+    /**
+     * @brief Prepares other for reduce(). When its leading coefficient is 1
+     *        or -1 and it is dense, also computes the power series inverse of
+     *        its reversal to quotient_length terms, so reducing a polynomial
+     *        whose quotient is at most that long costs two truncated products.
+     */
+    static divisor prepare_divisor(const polynomial &other, size_t quotient_length = 0);
+
+    /**
+     * @brief Reduces this polynomial in place by d, with the same semantics as %
+     */
+    void reduce(const divisor &d);
+
+    // coeff_map only ever holds non-zero coefficients, so the zero polynomial
+    // is the empty map and degree is always the map's last key (or 0).
+
+    /**
+     * @brief Adds c to the coefficient of x^p, erasing the term if it wraps to
+     *        zero, and keeps degree current
+     */
+    void add_term(power p, coeff c);
+
+    void update_degree();
+
 public:
     /**
      * @brief Construct a new polynomial object that is the number 0 (ie. 0x^0)
@@ -37,6 +71,15 @@ public:
      */
     polynomial();
 
+    /**
+     * @brief Construct the polynomial 0 whose terms are allocated from resource
+     *
+     * @param resource
+     *  The memory resource to allocate terms from; polynomials derived from
+     *  this one through +, * and % use the thread's current resource instead
+     */
+    explicit polynomial(std::pmr::memory_resource *resource);
+
     /**
      * @brief Construct a new polynomial object from an iterator to pairs of <power,coeff>
      *
@@ -51,8 +94,7 @@ public:
     polynomial(Iter begin, Iter end) {
         Iter i = begin;
         while (i != end) {
-            coeff_map[i -> first] += i -> second;
-            degree = std::max(i -> first, degree);
+            add_term(i -> first, i -> second);
             i++;
         }
     };
@@ -65,6 +107,13 @@ public:
      */
     polynomial(const polynomial &other);
 
+    /**
+     * @brief Construct from other's terms, taking its map in O(1) when it
+     *        lives in the current memory resource and copying otherwise.
+     *        other is left as the polynomial 0.
+     */
+    polynomial(polynomial &&other);
+
     /**
      * @brief Prints the polynomial.
      *
@@ -73,6 +122,11 @@ public:
      */
     void print() const;
 
+    /**
+     * @brief Returns the memory resource this polynomial's terms live in
+     */
+    std::pmr::memory_resource *resource() const;
+
     /**
      * @brief Turn the current polynomial instance into a deep copy of another
      * polynomial
@@ -84,6 +138,12 @@ public:
      */
     polynomial &operator=(const polynomial &other);
 
+    /**
+     * @brief Take other's terms, in O(1) when both live in the same memory
+     *        resource. other is left as the polynomial 0.
+     */
+    polynomial &operator=(polynomial &&other);
+
 
     /**
      * Overload the +, * and % operators. The function prototypes are not
@@ -113,6 +173,116 @@ public:
 
     polynomial operator%(const polynomial &other) const;
 
+    /**
+     * @brief Returns the terms of this * other with power below n, ie. the
+     *        product truncated as a power series. Terms that cannot reach
+     *        below n never enter the computation.
+     */
+    polynomial mul_low(const polynomial &other, size_t n) const;
+
+    /**
+     * @brief Returns the terms of this * other with power n or above, keeping
+     *        their powers. The dense path computes the low part of the product
+     *        of the reversed operands, so only the kept range is transformed.
+     */
+    polynomial mul_high(const polynomial &other, size_t n) const;
+
+    /**
+     * @brief Returns this polynomial squared. The dense path forward transforms
+     *        the operand once; p * p dispatches here as well.
+     */
+    polynomial square() const;
+
+    /**
+     * @brief Returns the exact product as (power, coefficient) pairs in
+     *        increasing power order, without wrapping coefficients to coeff.
+     *        Dense operands go through modular::multiply_exact, which runs
+     *        one NTT per CRT prime in parallel.
+     */
+    std::vector<std::pair<power, modular::wide_coeff>> multiply_wide(const polynomial &other) const;
+
+    /**
+     * @brief Returns this polynomial raised to the k-th power by repeated
+     *        squaring, ie. O(log k) multiplications. pow(0) is 1.
+     */
+    polynomial pow(size_t k) const;
+
+    /**
+     * @brief Returns this polynomial raised to the k-th power modulo m, reducing
+     *        after every squaring and multiplication. m is prepared once and
+     *        reused for every reduction; for a dense m with leading
+     *        coefficient 1 or -1 each reduction is two truncated products
+     *        against a precomputed inverse, otherwise long division.
+     *
+     *        Reduction follows % and stops at a leading coefficient that does
+     *        not divide evenly, so the result is only a true remainder when m's
+     *        leading coefficient is 1 or -1.
+     */
+    polynomial powmod(size_t k, const polynomial &m) const;
+
+    /**
+     * @brief Evaluates the polynomial at x with Horner's rule, skipping over
+     *        missing powers by repeated squaring
+     */
+    double evaluate(double x) const;
+
+    /**
+     * @brief Evaluates the polynomial at every point. Dense polynomials run
+     *        Horner's rule over a block of points at a time so the inner loop
+     *        vectorizes; blocks are spread across threads.
+     */
+    std::vector<double> evaluate(const std::vector<double> &xs) const;
+
+    /**
+     * @brief Evaluates the polynomial at x with coefficients taken modulo
+     *        modular::MOD
+     */
+    uint32_t evaluate_mod(uint32_t x) const;
+
+    /**
+     * @brief Evaluates the polynomial modulo modular::MOD at every point. Large
+     *        point sets go through a subproduct tree, ie. O(M(n) log n) instead
+     *        of O(n * degree).
+     */
+    std::vector<uint32_t> evaluate_mod(const std::vector<uint32_t> &xs) const;
+
+    /**
+     * @brief Returns the dense coefficients modulo modular::MOD
+     */
+    modular::mod_poly to_mod_poly() const;
+
+    /**
+     * @brief Builds a polynomial from residues modulo modular::MOD, each of
+     *        which fits in a coeff
+     */
+    static polynomial from_mod_poly(const modular::mod_poly &a);
+
+    /**
+     * @brief Returns the polynomial of degree below points.size() that takes
+     *        values[i] at points[i], modulo modular::MOD. Uses a subproduct
+     *        tree whose levels are combined in parallel, ie. O(M(n) log n).
+     *
+     * @throws std::invalid_argument
+     *  If the sizes differ or two points are equal modulo modular::MOD
+     */
+    static polynomial interpolate(const std::vector<uint32_t> &points, const std::vector<uint32_t> &values);
+
+    /**
+     * @brief Reads terms written one per line as cx^p (eg. -12x^7) up to a
+     *        line holding ";" or the end of the stream. Blank lines are
+     *        skipped and repeated powers are summed.
+     *
+     * @throws std::invalid_argument
+     *  If a line is not a term
+     */
+    static polynomial parse(std::istream &in);
+
+    /**
+     * @brief Writes the canonical form in the format parse() reads, followed
+     *        by a ";" line
+     */
+    void write(std::ostream &out) const;
+
     bool is_sparse(double threshold = 0.2) const;
 
     /**
@@ -121,7 +291,29 @@ public:
      * @return size_t
      *  The degree of the polynomial
      */
-    size_t find_degree_of();
+    size_t find_degree_of() const;
+
+    /**
+     * @brief Returns the coefficient of the highest term, or 0 for the zero
+     *        polynomial, without scanning the terms
+     */
+    coeff leading_coeff() const;
+
+    /**
+     * @brief Returns the number of terms with a non-zero coefficient
+     */
+    size_t term_count() const;
+
+    /**
+     * @brief Calls f(power, coeff) for every non-zero term in increasing
+     *        power order, without building a copy of the terms
+     */
+    template <typename F>
+    void for_each_term(F f) const {
+        for (const auto& [p, c] : coeff_map) {
+            f(p, c);
+        }
+    }
 
     /**
      * @brief Returns a vector that contains the polynomial is canonical form. This
@@ -144,14 +336,111 @@ public:
      *  A vector of pairs representing the canonical form of the polynomial
      */
     std::vector<std::pair<power, coeff>> canonical_form() const;
+
+    /**
+     * @brief Returns a hash of the terms. Equal polynomials hash equally
+     *        whatever resource their terms live in.
+     */
+    size_t hash() const;
+
+    bool operator==(const polynomial &other) const;
+    bool operator!=(const polynomial &other) const;
 };
 
 polynomial operator+(const int val, const polynomial& other);
 
 polynomial operator*(const int val, const polynomial& other);
 
+/**
+ * @brief Scratch space for the FFT kernels, one per thread. Buffers keep the
+ *        capacity of the largest transform seen, so steady-state dense
+ *        multiplication does not allocate. Call trim() to give the memory back.
+ */
+class fft_workspace
+{
+private:
+    std::array<std::vector<std::complex<double>>, 16> buffers;
+    std::vector<std::complex<double>> root_table;
+    size_t root_size = 0;
+
+public:
+    /**
+     * Buffers [0, SCRATCH) hold operands and products; buffer SCRATCH + i is
+     * the transform scratch space for operand i.
+     */
+    static const size_t SCRATCH = 8;
+
+    /**
+     * @brief Returns the calling thread's workspace
+     */
+    static fft_workspace &local();
+
+    /**
+     * @brief Returns buffer i (0 <= i < 16) resized to n and zero-filled
+     */
+    std::vector<std::complex<double>> &buffer(size_t i, size_t n);
+
+    /**
+     * @brief Returns buffer i as it was left by the last call
+     */
+    std::vector<std::complex<double>> &buffer(size_t i) { return buffers.at(i); }
+
+    /**
+     * @brief Returns the unit roots exp(2 pi i k / N) for k < N, where N is
+     *        root_table_size() and a multiple of n. Transforms of length n read
+     *        every (N / n)-th entry.
+     */
+    const std::vector<std::complex<double>> &roots(size_t n);
+
+    size_t root_table_size() const;
+
+    /**
+     * @brief Releases every buffer and the root table
+     */
+    void trim();
+
+    /**
+     * @brief Returns the bytes currently held by the workspace
+     */
+    size_t bytes_reserved() const;
+};
+
+/**
+ * @brief Returns the monic GCD of a and b with coefficients taken modulo
+ *        modular::MOD, computed with half-GCD in O(M(n) log n)
+ */
+polynomial gcd(const polynomial &a, const polynomial &b);
+
+struct polynomial_gcd
+{
+    polynomial g, s, t;
+};
+
+/**
+ * @brief Returns the monic GCD g of a and b modulo modular::MOD together with
+ *        s and t such that s * a + t * b = g
+ */
+polynomial_gcd extended_gcd(const polynomial &a, const polynomial &b);
+
+/**
+ * @brief Returns the smallest length of the form 2^a 3^b 5^c that is at least
+ *        min_size
+ */
+size_t next_fft_size(size_t min_size);
+
+/**
+ * @brief Mixed-radix (2, 3, 4, 5) FFT of length n, in place in a, using
+ *        scratch (also of length n) and a root table from fft_workspace::roots
+ */
+void fft(std::complex<double> *a, std::complex<double> *scratch, size_t n, bool is_invert,
+         const std::vector<std::complex<double>> &roots, size_t root_size);
+
+/**
+ * @brief FFT of a.size() points, which must have no prime factors other than
+ *        2, 3 and 5
+ */
 void fft(std::vector<std::complex<double>> &a, bool is_invert);
 
-std::vector<std::complex<double>> convert2complex(const std::map<power, coeff> &m, size_t size);
+std::vector<std::complex<double>> convert2complex(const coeff_storage &m, size_t size);
 
 #endif
\ No newline at end of file
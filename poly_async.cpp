@@ -0,0 +1,119 @@
+#include "poly_async.h"
+
+#include <sstream>
+
+namespace poly_async {
+
+task_pool::task_pool(size_t threads) {
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&task_pool::run, this);
+    }
+}
+
+task_pool::~task_pool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+void task_pool::run() {
+    size_t seen_generation = 0;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || !queue.empty() || seen_generation != trim_generation; });
+            if (seen_generation != trim_generation) {
+                seen_generation = trim_generation;
+                lock.unlock();
+                fft_workspace::local().trim();
+                modular::ntt_workspace::local().trim();
+                lock.lock();
+                if (--pending_trims == 0) {
+                    trimmed.notify_all();
+                }
+                continue;
+            }
+            if (queue.empty()) {
+                return;
+            }
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        task();
+    }
+}
+
+void task_pool::trim_workspaces() {
+    std::unique_lock<std::mutex> lock(mutex);
+    // Let a trim already under way finish so pending_trims counts only ours.
+    trimmed.wait(lock, [this] { return pending_trims == 0; });
+    trim_generation++;
+    pending_trims = workers.size();
+    wake.notify_all();
+    trimmed.wait(lock, [this] { return pending_trims == 0; });
+}
+
+void task_pool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+task_pool &task_pool::shared() {
+    // At least two workers, so a pipeline overlaps stages even on one core.
+    static task_pool pool(std::max<size_t>(NUM_THREADS, 2));
+    return pool;
+}
+
+// Inputs handed over by value are copied into the default resource, since the
+// caller's current resource may be an arena released before the pool runs.
+static future<polynomial> detach(const polynomial &p) {
+    poly_memory::memory_scope scope(nullptr);
+    return make_ready(p);
+}
+
+future<polynomial> multiply_async(const future<polynomial> &a, const future<polynomial> &b) {
+    return combine(a, b, [](const polynomial &x, const polynomial &y) { return x * y; });
+}
+
+future<polynomial> multiply_async(const polynomial &a, const polynomial &b) {
+    return multiply_async(detach(a), detach(b));
+}
+
+future<polynomial> mod_async(const future<polynomial> &a, const future<polynomial> &b) {
+    return combine(a, b, [](const polynomial &x, const polynomial &y) { return x % y; });
+}
+
+future<polynomial> mod_async(const polynomial &a, const polynomial &b) {
+    return mod_async(detach(a), detach(b));
+}
+
+future<polynomial> parse_async(std::string text) {
+    return async([text = std::move(text)] {
+        std::istringstream in(text);
+        return polynomial::parse(in);
+    });
+}
+
+future<std::string> write_async(const future<polynomial> &p) {
+    return p.then([](const polynomial &value) {
+        std::ostringstream out;
+        value.write(out);
+        return out.str();
+    });
+}
+
+future<polynomial> parse_and_multiply_async(std::string a, std::string b) {
+    return multiply_async(parse_async(std::move(a)), parse_async(std::move(b)));
+}
+
+} // namespace poly_async
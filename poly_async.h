@@ -0,0 +1,279 @@
+#ifndef POLY_ASYNC_H
+#define POLY_ASYNC_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "poly.h"
+
+/**
+ * Non-blocking polynomial operations on a shared worker pool. Each operation
+ * returns a future; chaining one future into another registers a
+ * continuation instead of waiting, so a dependency graph such as
+ * (a * b) % m is scheduled as its inputs complete and only the final
+ * consumer ever blocks, in get().
+ */
+namespace poly_async {
+
+/**
+ * A fixed set of worker threads draining one FIFO queue.
+ */
+class task_pool
+{
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> queue;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+    // Bumped by trim_workspaces(); each worker trims once per bump.
+    size_t trim_generation = 0;
+    size_t pending_trims = 0;
+    std::condition_variable trimmed;
+
+    void run();
+
+public:
+    explicit task_pool(size_t threads = NUM_THREADS);
+
+    /**
+     * @brief Finishes every queued task, then joins the workers
+     */
+    ~task_pool();
+
+    task_pool(const task_pool &) = delete;
+    task_pool &operator=(const task_pool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    size_t size() const { return workers.size(); }
+
+    /**
+     * @brief Releases every worker's thread-local fft_workspace and
+     *        modular::ntt_workspace. Idle workers trim at once, busy ones
+     *        after their current task; returns once all of them have. Must
+     *        not be called from a task on this pool.
+     */
+    void trim_workspaces();
+
+    /**
+     * @brief The pool every async operation in this namespace runs on
+     */
+    static task_pool &shared();
+};
+
+namespace detail {
+
+/**
+ * The value or exception of one future and the continuations waiting on it.
+ * Once ready it never changes, so continuations read it without the lock.
+ */
+template <typename T>
+class shared_state
+{
+private:
+    std::mutex mutex;
+    std::condition_variable done;
+    bool ready = false;
+    std::vector<std::function<void()>> continuations;
+
+    template <typename Set>
+    void finish(Set set) {
+        std::vector<std::function<void()>> waiting;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            set();
+            ready = true;
+            waiting.swap(continuations);
+        }
+        done.notify_all();
+        for (auto& c : waiting) {
+            task_pool::shared().submit(std::move(c));
+        }
+    }
+
+public:
+    std::optional<T> value;
+    std::exception_ptr error;
+
+    void set_value(T v) {
+        finish([&] { value.emplace(std::move(v)); });
+    }
+
+    void set_exception(std::exception_ptr e) {
+        finish([&] { error = std::move(e); });
+    }
+
+    /**
+     * @brief Queues c on the pool once the state is ready (at once if it is)
+     */
+    void on_ready(std::function<void()> c) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!ready) {
+                continuations.push_back(std::move(c));
+                return;
+            }
+        }
+        task_pool::shared().submit(std::move(c));
+    }
+
+    bool is_ready() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return ready;
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return ready; });
+    }
+
+    /**
+     * @brief Stores f() or the exception it throws
+     */
+    template <typename F>
+    void fulfil(F &&f) {
+        try {
+            set_value(f());
+        }
+        catch (...) {
+            set_exception(std::current_exception());
+        }
+    }
+};
+
+} // namespace detail
+
+template <typename T>
+class future
+{
+private:
+    std::shared_ptr<detail::shared_state<T>> state;
+
+public:
+    explicit future(std::shared_ptr<detail::shared_state<T>> state) : state(std::move(state)) {}
+
+    const std::shared_ptr<detail::shared_state<T>> &shared() const { return state; }
+
+    bool ready() const { return state -> is_ready(); }
+
+    /**
+     * @brief Blocks until the value is available and returns it, or rethrows
+     *        the exception that produced it
+     */
+    const T &get() const {
+        state -> wait();
+        if (state -> error) {
+            std::rethrow_exception(state -> error);
+        }
+        return *state -> value;
+    }
+
+    /**
+     * @brief Returns a future for f(value), run on the pool once this one is
+     *        ready. An exception here skips f and is passed on.
+     */
+    template <typename F>
+    auto then(F f) const -> future<std::invoke_result_t<F, const T &>> {
+        using R = std::invoke_result_t<F, const T &>;
+        auto next = std::make_shared<detail::shared_state<R>>();
+        auto source = state;
+        source -> on_ready([source, next, f = std::move(f)]() mutable {
+            if (source -> error) {
+                next -> set_exception(source -> error);
+                return;
+            }
+            next -> fulfil([&] { return f(*source -> value); });
+        });
+        return future<R>(next);
+    }
+};
+
+/**
+ * @brief Returns an already completed future holding value
+ */
+template <typename T>
+future<T> make_ready(T value) {
+    auto state = std::make_shared<detail::shared_state<T>>();
+    state -> set_value(std::move(value));
+    return future<T>(state);
+}
+
+/**
+ * @brief Runs f on the pool and returns a future for its result
+ */
+template <typename F>
+auto async(F f) -> future<std::invoke_result_t<F>> {
+    using R = std::invoke_result_t<F>;
+    auto state = std::make_shared<detail::shared_state<R>>();
+    task_pool::shared().submit([state, f = std::move(f)]() mutable {
+        state -> fulfil(f);
+    });
+    return future<R>(state);
+}
+
+/**
+ * @brief Returns a future for f(a, b), run once both a and b are ready.
+ *        Whichever input finishes last runs f; no thread waits for the other.
+ */
+template <typename A, typename B, typename F>
+auto combine(const future<A> &a, const future<B> &b, F f) -> future<std::invoke_result_t<F, const A &, const B &>> {
+    using R = std::invoke_result_t<F, const A &, const B &>;
+    auto next = std::make_shared<detail::shared_state<R>>();
+    auto sa = a.shared();
+    auto sb = b.shared();
+    auto pending = std::make_shared<std::atomic<int>>(2);
+    auto fire = std::make_shared<std::function<void()>>([sa, sb, next, f = std::move(f)]() mutable {
+        if (sa -> error || sb -> error) {
+            next -> set_exception(sa -> error ? sa -> error : sb -> error);
+            return;
+        }
+        next -> fulfil([&] { return f(*sa -> value, *sb -> value); });
+    });
+    auto arrive = [pending, fire]() {
+        if (pending -> fetch_sub(1) == 1) {
+            (*fire)();
+        }
+    };
+    sa -> on_ready(arrive);
+    sb -> on_ready(arrive);
+    return future<R>(next);
+}
+
+future<polynomial> multiply_async(const future<polynomial> &a, const future<polynomial> &b);
+
+future<polynomial> multiply_async(const polynomial &a, const polynomial &b);
+
+future<polynomial> mod_async(const future<polynomial> &a, const future<polynomial> &b);
+
+future<polynomial> mod_async(const polynomial &a, const polynomial &b);
+
+/**
+ * @brief Parses text in polynomial::parse() format on the pool
+ */
+future<polynomial> parse_async(std::string text);
+
+/**
+ * @brief Serializes p with polynomial::write() on the pool once it is ready
+ */
+future<std::string> write_async(const future<polynomial> &p);
+
+/**
+ * @brief Parses both texts concurrently and multiplies them once both are in
+ */
+future<polynomial> parse_and_multiply_async(std::string a, std::string b);
+
+} // namespace poly_async
+
+#endif
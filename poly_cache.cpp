@@ -0,0 +1,130 @@
+#include "poly_cache.h"
+
+namespace poly_cache {
+
+// Interned nodes by hash. Entries are weak so the table never keeps a value
+// alive; expired ones are dropped as their bucket is scanned and by a sweep
+// whenever the table doubles.
+static std::mutex table_mutex;
+static std::unordered_multimap<size_t, std::weak_ptr<const handle::node>> table;
+static size_t sweep_at = 1024;
+
+handle::node::node(const polynomial &p, size_t h) : value(std::pmr::get_default_resource()), hash(h) {
+    value = p;
+}
+
+handle::handle(std::shared_ptr<const node> ptr) : ptr(std::move(ptr)) {}
+
+handle::handle() : handle(intern(polynomial(std::pmr::get_default_resource()))) {}
+
+handle handle::intern(const polynomial &p) {
+    size_t h = p.hash();
+    std::lock_guard<std::mutex> lock(table_mutex);
+
+    auto [begin, end] = table.equal_range(h);
+    for (auto i = begin; i != end;) {
+        std::shared_ptr<const node> existing = i -> second.lock();
+        if (!existing) {
+            i = table.erase(i);
+            continue;
+        }
+        if (existing -> value == p) {
+            return handle(std::move(existing));
+        }
+        i++;
+    }
+
+    if (table.size() >= sweep_at) {
+        for (auto i = table.begin(); i != table.end();) {
+            i = i -> second.expired() ? table.erase(i) : std::next(i);
+        }
+        sweep_at = std::max<size_t>(1024, 2 * table.size());
+    }
+
+    auto created = std::make_shared<const node>(p, h);
+    table.emplace(h, created);
+    return handle(std::move(created));
+}
+
+size_t handle::interned_count() {
+    std::lock_guard<std::mutex> lock(table_mutex);
+    size_t live = 0;
+    for (const auto& [h, weak] : table) {
+        if (!weak.expired()) {
+            live++;
+        }
+    }
+    return live;
+}
+
+bool memo_cache::key::operator==(const key &other) const {
+    return operation == other.operation && a == other.a && b == other.b;
+}
+
+size_t memo_cache::key_hash::operator()(const key &k) const {
+    size_t h = k.a.hash() * 0x9e3779b97f4a7c15ULL ^ k.b.hash();
+    return h * 31 + static_cast<size_t>(k.operation);
+}
+
+memo_cache::memo_cache(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+handle memo_cache::lookup(op operation, const handle &a, const handle &b) {
+    key k{operation, a, b};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(k);
+        if (found != index.end()) {
+            order.splice(order.begin(), order, found -> second);
+            stats_.hits++;
+            return found -> second -> second;
+        }
+        stats_.misses++;
+    }
+
+    // Two threads missing on the same key both compute it; the second insert
+    // just refreshes the entry.
+    polynomial result = operation == op::multiply ? *a * *b : *a % *b;
+    handle value = handle::intern(result);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(k);
+    if (found != index.end()) {
+        order.splice(order.begin(), order, found -> second);
+        return found -> second -> second;
+    }
+    order.emplace_front(k, value);
+    index.emplace(std::move(k), order.begin());
+    if (order.size() > capacity) {
+        index.erase(order.back().first);
+        order.pop_back();
+        stats_.evictions++;
+    }
+    return value;
+}
+
+handle memo_cache::multiply(const handle &a, const handle &b) {
+    return lookup(op::multiply, a, b);
+}
+
+handle memo_cache::mod(const handle &a, const handle &b) {
+    return lookup(op::modulo, a, b);
+}
+
+cache_stats memo_cache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats_;
+}
+
+size_t memo_cache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return order.size();
+}
+
+void memo_cache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    index.clear();
+    order.clear();
+    stats_ = cache_stats();
+}
+
+} // namespace poly_cache
@@ -0,0 +1,138 @@
+#ifndef POLY_CACHE_H
+#define POLY_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "poly.h"
+
+/**
+ * Immutable, hash-consed polynomials and a memo cache of results over them.
+ * Interning makes equal polynomials share one node, so handles compare and
+ * hash in O(1) and copying a handle only bumps a reference count.
+ */
+namespace poly_cache {
+
+/**
+ * A shared reference to an immutable interned polynomial. While any handle to
+ * a value is alive, interning an equal polynomial returns that same node.
+ */
+class handle
+{
+public:
+    // The interned value; only reachable through a handle.
+    struct node
+    {
+        polynomial value;
+        size_t hash;
+
+        node(const polynomial &p, size_t h);
+    };
+
+private:
+    std::shared_ptr<const node> ptr;
+
+    explicit handle(std::shared_ptr<const node> ptr);
+
+public:
+    /**
+     * @brief The zero polynomial
+     */
+    handle();
+
+    /**
+     * @brief Interns p. Its terms are copied into the default resource, so the
+     *        handle may outlive any arena p was built in.
+     */
+    static handle intern(const polynomial &p);
+
+    const polynomial &get() const { return ptr -> value; }
+    const polynomial &operator*() const { return ptr -> value; }
+    const polynomial *operator->() const { return &ptr -> value; }
+
+    size_t hash() const { return ptr -> hash; }
+
+    /**
+     * @brief Interned values are unique, so equality is node identity.
+     */
+    bool operator==(const handle &other) const { return ptr == other.ptr; }
+    bool operator!=(const handle &other) const { return ptr != other.ptr; }
+
+    /**
+     * @brief Returns the number of distinct live interned polynomials
+     */
+    static size_t interned_count();
+};
+
+struct cache_stats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+/**
+ * A bounded least-recently-used cache of * and % results, keyed on the
+ * operation and its operands. Entries hold their operands, so a key's nodes
+ * cannot be recycled while the entry exists. Safe to share between threads;
+ * the operation itself runs outside the lock.
+ */
+class memo_cache
+{
+private:
+    enum class op : uint8_t { multiply, modulo };
+
+    struct key
+    {
+        op operation;
+        handle a, b;
+
+        bool operator==(const key &other) const;
+    };
+
+    struct key_hash
+    {
+        size_t operator()(const key &k) const;
+    };
+
+    using entry = std::pair<key, handle>;
+
+    size_t capacity;
+    // Most recently used first.
+    std::list<entry> order;
+    std::unordered_map<key, std::list<entry>::iterator, key_hash> index;
+    cache_stats stats_;
+    mutable std::mutex mutex;
+
+    handle lookup(op operation, const handle &a, const handle &b);
+
+public:
+    /**
+     * @param capacity
+     *  The most results kept; the least recently used one is evicted past it
+     */
+    explicit memo_cache(size_t capacity = 1024);
+
+    memo_cache(const memo_cache &) = delete;
+    memo_cache &operator=(const memo_cache &) = delete;
+
+    handle multiply(const handle &a, const handle &b);
+
+    handle mod(const handle &a, const handle &b);
+
+    cache_stats stats() const;
+
+    size_t size() const;
+
+    /**
+     * @brief Drops every entry and zeroes the statistics
+     */
+    void clear();
+};
+
+} // namespace poly_cache
+
+#endif
@@ -0,0 +1,46 @@
+#include "poly_memory.h"
+
+namespace poly_memory {
+
+static thread_local std::pmr::memory_resource *current = nullptr;
+
+std::pmr::memory_resource *current_resource() {
+    return current ? current : std::pmr::get_default_resource();
+}
+
+void set_current_resource(std::pmr::memory_resource *resource) {
+    current = resource;
+}
+
+std::pmr::memory_resource *thread_pool() {
+    static thread_local std::pmr::unsynchronized_pool_resource pool;
+    return &pool;
+}
+
+memory_scope::memory_scope(std::pmr::memory_resource *resource) : previous(current) {
+    current = resource;
+}
+
+memory_scope::~memory_scope() {
+    current = previous;
+}
+
+arena::arena(size_t initial_size, std::pmr::memory_resource *upstream) : buffer(initial_size, upstream) {}
+
+void *arena::do_allocate(size_t bytes, size_t alignment) {
+    return buffer.allocate(bytes, alignment);
+}
+
+void arena::do_deallocate(void *p, size_t bytes, size_t alignment) {
+    buffer.deallocate(p, bytes, alignment);
+}
+
+bool arena::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
+
+void arena::release() {
+    buffer.release();
+}
+
+} // namespace poly_memory
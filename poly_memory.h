@@ -0,0 +1,78 @@
+#ifndef POLY_MEMORY_H
+#define POLY_MEMORY_H
+
+#include <cstddef>
+#include <memory_resource>
+
+/**
+ * Storage for polynomial terms comes from a std::pmr::memory_resource.
+ * Every polynomial created on a thread (including the temporaries and
+ * results inside +, * and %) takes the thread's current resource, which is
+ * std::pmr::get_default_resource() unless a memory_scope is active.
+ */
+namespace poly_memory {
+
+/**
+ * @brief Returns the resource new polynomials on this thread allocate from.
+ */
+std::pmr::memory_resource *current_resource();
+
+/**
+ * @brief Makes resource the current resource of this thread. Passing nullptr
+ *        restores the default resource.
+ */
+void set_current_resource(std::pmr::memory_resource *resource);
+
+/**
+ * @brief Returns a pool owned by the calling thread. It needs no locking, so
+ *        polynomials allocated from it must stay on this thread and must not
+ *        outlive it.
+ */
+std::pmr::memory_resource *thread_pool();
+
+/**
+ * @brief Sets the current resource for the lifetime of the scope and restores
+ *        the previous one afterwards.
+ */
+class memory_scope
+{
+private:
+    std::pmr::memory_resource *previous;
+
+public:
+    explicit memory_scope(std::pmr::memory_resource *resource);
+    ~memory_scope();
+
+    memory_scope(const memory_scope &) = delete;
+    memory_scope &operator=(const memory_scope &) = delete;
+};
+
+/**
+ * @brief A monotonic arena. Deallocation is a no-op; everything allocated
+ *        from it is released at once by release() or on destruction, so every
+ *        polynomial using it must be gone by then.
+ */
+class arena : public std::pmr::memory_resource
+{
+private:
+    std::pmr::monotonic_buffer_resource buffer;
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+public:
+    /**
+     * @param initial_size
+     *  Bytes requested from upstream for the first block; later blocks grow
+     *  geometrically.
+     */
+    explicit arena(size_t initial_size = 1 << 16,
+                   std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+
+    void release();
+};
+
+} // namespace poly_memory
+
+#endif
@@ -0,0 +1,727 @@
+#include "poly_mod.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <tuple>
+
+namespace modular {
+
+uint32_t pow_mod(uint32_t base, uint64_t exponent, uint32_t mod) {
+    uint32_t result = 1 % mod;
+    while (exponent > 0) {
+        if (exponent & 1) {
+            result = mul(result, base, mod);
+        }
+        base = mul(base, base, mod);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+uint32_t inverse(uint32_t a, uint32_t mod) {
+    return pow_mod(a, mod - 2, mod);
+}
+
+uint32_t reduce(int64_t c) {
+    int64_t r = c % MOD;
+    return static_cast<uint32_t>(r < 0 ? r + MOD : r);
+}
+
+void trim(mod_poly &a) {
+    while (!a.empty() && a.back() == 0) {
+        a.pop_back();
+    }
+}
+
+// Shoup multiplication: with w_shoup = floor(w * 2^32 / mod) precomputed, a * w
+// mod mod needs no division.
+static inline uint32_t mul_shoup(uint32_t a, uint32_t w, uint32_t w_shoup, uint32_t mod) {
+    uint32_t q = static_cast<uint32_t>((static_cast<uint64_t>(a) * w_shoup) >> 32);
+    uint32_t r = a * w - q * mod;
+    return r >= mod ? r - mod : r;
+}
+
+ntt_workspace &ntt_workspace::local() {
+    static thread_local ntt_workspace workspace;
+    return workspace;
+}
+
+const ntt_workspace::twiddles &ntt_workspace::table(uint32_t mod, uint32_t root, size_t n) {
+    auto found = std::find_if(tables.begin(), tables.end(),
+                              [&](const twiddles &t) { return t.mod == mod && t.root == root; });
+    if (found == tables.end()) {
+        tables.push_back({mod, root, {}, {}});
+        found = tables.end() - 1;
+    }
+    twiddles &t = *found;
+    if (t.w.size() >= n) {
+        return t;
+    }
+
+    // Twiddles for stage len live at [len / 2, len): the powers of a primitive
+    // len-th root of unity, each stage being every other entry of the next.
+    std::vector<uint32_t> &w = t.w, &w_shoup = t.w_shoup;
+    w.assign(n, 0);
+    w_shoup.assign(n, 0);
+    uint32_t w_n = pow_mod(root, (mod - 1) / n, mod);
+    w[n / 2] = 1;
+    for (size_t k = n / 2 + 1; k < n; k++) {
+        w[k] = mul(w[k - 1], w_n, mod);
+    }
+    for (size_t k = n / 2; k-- > 1; ) {
+        w[k] = w[2 * k];
+    }
+    for (size_t k = 1; k < n; k++) {
+        w_shoup[k] = static_cast<uint32_t>((static_cast<uint64_t>(w[k]) << 32) / mod);
+    }
+    return t;
+}
+
+void ntt_workspace::trim() {
+    std::vector<twiddles>().swap(tables);
+}
+
+size_t ntt_workspace::bytes_reserved() const {
+    size_t total = 0;
+    for (const twiddles &t : tables) {
+        total += t.w.capacity() + t.w_shoup.capacity();
+    }
+    return total * sizeof(uint32_t);
+}
+
+void ntt(std::vector<uint32_t> &a, bool is_invert, uint32_t mod, uint32_t root) {
+    size_t n = a.size();
+    if (n <= 1) {
+        return;
+    }
+
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(a[i], a[j]);
+        }
+    }
+
+    const ntt_workspace::twiddles &t = ntt_workspace::local().table(mod, root, n);
+    const std::vector<uint32_t> &w = t.w;
+    const std::vector<uint32_t> &w_shoup = t.w_shoup;
+
+    for (size_t len = 2; len <= n; len <<= 1) {
+        size_t half = len / 2;
+        const uint32_t *stage_w = w.data() + half;
+        const uint32_t *stage_shoup = w_shoup.data() + half;
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t k = 0; k < half; k++) {
+                uint32_t u = a[i + k];
+                uint32_t v = mul_shoup(a[i + k + half], stage_w[k], stage_shoup[k], mod);
+                a[i + k] = add(u, v, mod);
+                a[i + k + half] = sub(u, v, mod);
+            }
+        }
+    }
+
+    if (is_invert) {
+        // The inverse transform is the forward one read backwards.
+        std::reverse(a.begin() + 1, a.end());
+        uint32_t n_inv = inverse(static_cast<uint32_t>(n % mod), mod);
+        for (uint32_t &x : a) {
+            x = mul(x, n_inv, mod);
+        }
+    }
+}
+
+mod_poly multiply(const mod_poly &a, const mod_poly &b, uint32_t mod, uint32_t root) {
+    if (a.empty() || b.empty()) {
+        return {};
+    }
+
+    if (std::min(a.size(), b.size()) < NTT_THRESHOLD) {
+        mod_poly result(a.size() + b.size() - 1);
+        for (size_t i = 0; i < a.size(); i++) {
+            for (size_t j = 0; j < b.size(); j++) {
+                result[i + j] = add(result[i + j], mul(a[i], b[j], mod), mod);
+            }
+        }
+        trim(result);
+        return result;
+    }
+
+    size_t product_length = a.size() + b.size() - 1;
+    size_t n = 1;
+    while (n < product_length) {
+        n <<= 1;
+    }
+
+    std::vector<uint32_t> fa(a.begin(), a.end());
+    fa.resize(n);
+    ntt(fa, false, mod, root);
+    if (&a == &b) {
+        for (size_t i = 0; i < n; i++) {
+            fa[i] = mul(fa[i], fa[i], mod);
+        }
+    }
+    else {
+        std::vector<uint32_t> fb(b.begin(), b.end());
+        fb.resize(n);
+        ntt(fb, false, mod, root);
+        for (size_t i = 0; i < n; i++) {
+            fa[i] = mul(fa[i], fb[i], mod);
+        }
+    }
+    ntt(fa, true, mod, root);
+
+    fa.resize(product_length);
+    trim(fa);
+    return fa;
+}
+
+mod_poly add(const mod_poly &a, const mod_poly &b) {
+    mod_poly result(std::max(a.size(), b.size()));
+    for (size_t i = 0; i < result.size(); i++) {
+        result[i] = add(i < a.size() ? a[i] : 0, i < b.size() ? b[i] : 0);
+    }
+    trim(result);
+    return result;
+}
+
+mod_poly sub(const mod_poly &a, const mod_poly &b) {
+    mod_poly result(std::max(a.size(), b.size()));
+    for (size_t i = 0; i < result.size(); i++) {
+        result[i] = sub(i < a.size() ? a[i] : 0, i < b.size() ? b[i] : 0);
+    }
+    trim(result);
+    return result;
+}
+
+mod_poly inverse_series(const mod_poly &a, size_t n) {
+    // Newton iteration: g <- g * (2 - a * g), doubling the precision each step.
+    mod_poly g = {inverse(a[0])};
+    for (size_t len = 1; len < n; len <<= 1) {
+        size_t next = 2 * len;
+        mod_poly a_low(a.begin(), a.begin() + std::min(a.size(), next));
+        mod_poly t = multiply(a_low, g);
+        t.resize(next);
+        for (uint32_t &x : t) {
+            x = sub(0, x);
+        }
+        t[0] = add(t[0], 2);
+        g = multiply(g, t);
+        g.resize(next);
+    }
+    g.resize(n);
+    trim(g);
+    return g;
+}
+
+std::pair<mod_poly, mod_poly> divmod(const mod_poly &a, const mod_poly &b) {
+    if (a.size() < b.size()) {
+        return {{}, a};
+    }
+    size_t quotient_length = a.size() - b.size() + 1;
+
+    if (b.size() < NTT_THRESHOLD || quotient_length < NTT_THRESHOLD) {
+        mod_poly q(quotient_length);
+        mod_poly r(a);
+        uint32_t lead_inv = inverse(b.back());
+        for (size_t i = quotient_length; i-- > 0; ) {
+            uint32_t c = mul(r[i + b.size() - 1], lead_inv);
+            q[i] = c;
+            if (c == 0) {
+                continue;
+            }
+            for (size_t j = 0; j < b.size(); j++) {
+                r[i + j] = sub(r[i + j], mul(c, b[j]));
+            }
+        }
+        r.resize(b.size() - 1);
+        trim(q);
+        trim(r);
+        return {q, r};
+    }
+
+    // rev(q) = rev(a) / rev(b) mod x^quotient_length, where rev reverses the
+    // coefficient order.
+    mod_poly reversed_a(a.rbegin(), a.rbegin() + quotient_length);
+    mod_poly reversed_b(b.rbegin(), b.rend());
+    mod_poly q = multiply(reversed_a, inverse_series(reversed_b, quotient_length));
+    q.resize(quotient_length);
+    std::reverse(q.begin(), q.end());
+    trim(q);
+
+    mod_poly r = sub(a, multiply(b, q));
+    r.resize(std::min(r.size(), b.size() - 1));
+    trim(r);
+    return {q, r};
+}
+
+mod_poly remainder(const mod_poly &a, const mod_poly &b) {
+    if (a.size() < b.size()) {
+        return a;
+    }
+    return divmod(a, b).second;
+}
+
+uint32_t evaluate(const mod_poly &a, uint32_t x) {
+    uint32_t result = 0;
+    for (size_t i = a.size(); i-- > 0; ) {
+        result = add(mul(result, x), a[i]);
+    }
+    return result;
+}
+
+// Nodes covering at most this many points are finished with Horner's rule.
+static const size_t LEAF_POINTS = 16;
+
+// Roughly how many coefficients a thread should own before it is worth
+// starting one.
+static size_t node_chunk(const mod_poly &node) {
+    return std::max<size_t>(1, 4096 / std::max<size_t>(1, node.size()));
+}
+
+subproduct_tree::subproduct_tree(const std::vector<uint32_t> &points) : points(points) {
+    if (points.empty()) {
+        levels.push_back({{1}});
+        return;
+    }
+
+    std::vector<mod_poly> leaves(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        leaves[i] = {sub(0, points[i]), 1};
+    }
+    levels.push_back(std::move(leaves));
+
+    while (levels.back().size() > 1) {
+        const std::vector<mod_poly> &below = levels.back();
+        std::vector<mod_poly> above((below.size() + 1) / 2);
+        parallel_for(above.size(), node_chunk(below[0]), [&](size_t begin, size_t end) {
+            for (size_t j = begin; j < end; j++) {
+                above[j] = 2 * j + 1 < below.size() ? multiply(below[2 * j], below[2 * j + 1]) : below[2 * j];
+            }
+        });
+        levels.push_back(std::move(above));
+    }
+}
+
+const mod_poly &subproduct_tree::root() const {
+    return levels.back()[0];
+}
+
+std::vector<uint32_t> subproduct_tree::evaluate(const mod_poly &f) const {
+    std::vector<uint32_t> values(points.size());
+    if (points.empty()) {
+        return values;
+    }
+
+    size_t level = levels.size() - 1;
+    std::vector<mod_poly> current = {remainder(f, root())};
+    while (level > 0 && (size_t(1) << level) > LEAF_POINTS) {
+        const std::vector<mod_poly> &children = levels[--level];
+        std::vector<mod_poly> next(children.size());
+        parallel_for(children.size(), node_chunk(children[0]), [&](size_t begin, size_t end) {
+            for (size_t j = begin; j < end; j++) {
+                next[j] = remainder(current[j / 2], children[j]);
+            }
+        });
+        current = std::move(next);
+    }
+
+    size_t span = size_t(1) << level;
+    parallel_for(current.size(), 64, [&](size_t begin, size_t end) {
+        for (size_t j = begin; j < end; j++) {
+            for (size_t i = j * span; i < std::min(points.size(), (j + 1) * span); i++) {
+                values[i] = modular::evaluate(current[j], points[i]);
+            }
+        }
+    });
+    return values;
+}
+
+mod_poly subproduct_tree::interpolate(const std::vector<uint32_t> &values) const {
+    // Lagrange: f = sum values[i] / M'(x_i) * M / (x - x_i) with M the root.
+    // The weights come from one multipoint evaluation of M'; the sum is
+    // assembled bottom-up as left * M_right + right * M_left.
+    const mod_poly &m = root();
+    mod_poly derivative(m.size() > 1 ? m.size() - 1 : 0);
+    for (size_t i = 1; i < m.size(); i++) {
+        derivative[i - 1] = mul(m[i], static_cast<uint32_t>(i % MOD));
+    }
+    trim(derivative);
+    std::vector<uint32_t> weights = evaluate(derivative);
+
+    std::vector<mod_poly> current(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        if (weights[i] == 0) {
+            throw std::invalid_argument("interpolation points must be distinct");
+        }
+        current[i] = {mul(values[i], inverse(weights[i]))};
+        trim(current[i]);
+    }
+
+    for (size_t level = 0; level + 1 < levels.size(); level++) {
+        const std::vector<mod_poly> &nodes = levels[level];
+        std::vector<mod_poly> next((current.size() + 1) / 2);
+        parallel_for(next.size(), node_chunk(nodes[0]), [&](size_t begin, size_t end) {
+            for (size_t j = begin; j < end; j++) {
+                if (2 * j + 1 < current.size()) {
+                    next[j] = add(multiply(current[2 * j], nodes[2 * j + 1]), multiply(current[2 * j + 1], nodes[2 * j]));
+                }
+                else {
+                    next[j] = current[2 * j];
+                }
+            }
+        });
+        current = std::move(next);
+    }
+    return current.empty() ? mod_poly() : current[0];
+}
+
+mod_poly interpolate(const std::vector<uint32_t> &points, const std::vector<uint32_t> &values) {
+    if (points.size() != values.size()) {
+        throw std::invalid_argument("interpolation needs one value per point");
+    }
+    std::vector<uint32_t> reduced_points(points.size()), reduced_values(values.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        reduced_points[i] = points[i] % MOD;
+        reduced_values[i] = values[i] % MOD;
+    }
+    return subproduct_tree(reduced_points).interpolate(reduced_values);
+}
+
+std::vector<uint32_t> evaluate(const mod_poly &a, const std::vector<uint32_t> &xs) {
+    if (xs.size() < MULTIPOINT_THRESHOLD || a.size() < MULTIPOINT_THRESHOLD) {
+        std::vector<uint32_t> values(xs.size());
+        parallel_for(xs.size(), std::max<size_t>(1, 65536 / std::max<size_t>(1, a.size())),
+                     [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                values[i] = evaluate(a, xs[i]);
+            }
+        });
+        return values;
+    }
+
+    // Evaluate block by block so each tree has about as many points as the
+    // polynomial has coefficients.
+    std::vector<uint32_t> values;
+    values.reserve(xs.size());
+    for (size_t begin = 0; begin < xs.size(); begin += a.size()) {
+        std::vector<uint32_t> block(xs.begin() + begin, xs.begin() + std::min(xs.size(), begin + a.size()));
+        std::vector<uint32_t> block_values = subproduct_tree(block).evaluate(a);
+        values.insert(values.end(), block_values.begin(), block_values.end());
+    }
+    return values;
+}
+
+// Computes several sums of products over a shared set of operands, forward
+// transforming each operand once and inverse transforming each sum once.
+static std::vector<mod_poly> sums_of_products(const std::vector<const mod_poly *> &operands,
+                                              const std::vector<std::vector<std::pair<size_t, size_t>>> &sums) {
+    size_t product_length = 0;
+    size_t smallest = SIZE_MAX;
+    for (const auto& terms : sums) {
+        for (const auto& [x, y] : terms) {
+            if (!operands[x] -> empty() && !operands[y] -> empty()) {
+                product_length = std::max(product_length, operands[x] -> size() + operands[y] -> size() - 1);
+                smallest = std::min({smallest, operands[x] -> size(), operands[y] -> size()});
+            }
+        }
+    }
+
+    std::vector<mod_poly> results(sums.size());
+    if (product_length == 0 || smallest < NTT_THRESHOLD) {
+        for (size_t k = 0; k < sums.size(); k++) {
+            for (const auto& [x, y] : sums[k]) {
+                results[k] = add(results[k], multiply(*operands[x], *operands[y]));
+            }
+        }
+        return results;
+    }
+
+    size_t n = 1;
+    while (n < product_length) {
+        n <<= 1;
+    }
+    std::vector<std::vector<uint32_t>> transformed(operands.size());
+    for (size_t i = 0; i < operands.size(); i++) {
+        transformed[i].assign(operands[i] -> begin(), operands[i] -> end());
+        transformed[i].resize(n);
+        ntt(transformed[i], false);
+    }
+    for (size_t k = 0; k < sums.size(); k++) {
+        std::vector<uint32_t> sum(n);
+        for (const auto& [x, y] : sums[k]) {
+            for (size_t i = 0; i < n; i++) {
+                sum[i] = add(sum[i], mul(transformed[x][i], transformed[y][i]));
+            }
+        }
+        ntt(sum, true);
+        trim(sum);
+        results[k] = std::move(sum);
+    }
+    return results;
+}
+
+std::pair<mod_poly, mod_poly> transform::apply(const mod_poly &a, const mod_poly &b) const {
+    auto results = sums_of_products({&m00, &m01, &m10, &m11, &a, &b}, {{{0, 4}, {1, 5}}, {{2, 4}, {3, 5}}});
+    return {std::move(results[0]), std::move(results[1])};
+}
+
+transform transform::after(const transform &other) const {
+    const transform &o = other;
+    auto results = sums_of_products({&m00, &m01, &m10, &m11, &o.m00, &o.m01, &o.m10, &o.m11},
+                                    {{{0, 4}, {1, 6}}, {{0, 5}, {1, 7}}, {{2, 4}, {3, 6}}, {{2, 5}, {3, 7}}});
+    transform result;
+    result.m00 = std::move(results[0]);
+    result.m01 = std::move(results[1]);
+    result.m10 = std::move(results[2]);
+    result.m11 = std::move(results[3]);
+    return result;
+}
+
+static size_t degree_of(const mod_poly &a) {
+    return a.empty() ? 0 : a.size() - 1;
+}
+
+// Drops the k lowest coefficients, ie. a div x^k.
+static mod_poly shift_down(const mod_poly &a, size_t k) {
+    return k >= a.size() ? mod_poly() : mod_poly(a.begin() + k, a.end());
+}
+
+// One Euclid step: (a, b) <- (b, a mod b), recorded in t.
+static void euclid_step(mod_poly &a, mod_poly &b, transform &t) {
+    auto [q, r] = divmod(a, b);
+    a = std::move(b);
+    b = std::move(r);
+
+    // [[0, 1], [1, -q]] * t
+    mod_poly m10 = sub(t.m00, multiply(q, t.m10));
+    mod_poly m11 = sub(t.m01, multiply(q, t.m11));
+    t.m00 = std::move(t.m10);
+    t.m01 = std::move(t.m11);
+    t.m10 = std::move(m10);
+    t.m11 = std::move(m11);
+}
+
+transform half_gcd(const mod_poly &a, const mod_poly &b) {
+    size_t m = (degree_of(a) + 1) / 2;
+    transform result;
+    if (b.empty() || degree_of(b) < m) {
+        return result;
+    }
+
+    if (degree_of(a) < HGCD_THRESHOLD) {
+        mod_poly c = a, d = b;
+        while (!d.empty() && degree_of(d) >= m) {
+            euclid_step(c, d, result);
+        }
+        return result;
+    }
+
+    // The quotients of the top halves match those of (a, b) until the
+    // remainders fall below half of the top halves' degree.
+    result = half_gcd(shift_down(a, m), shift_down(b, m));
+    auto [c, d] = result.apply(a, b);
+    if (d.empty() || degree_of(d) < m) {
+        return result;
+    }
+
+    euclid_step(c, d, result);
+    if (d.empty() || degree_of(d) < m) {
+        return result;
+    }
+
+    // Choose k so that half of deg(c div x^k) lands exactly on m.
+    size_t k = 2 * m - degree_of(c);
+    return half_gcd(shift_down(c, k), shift_down(d, k)).after(result);
+}
+
+// Runs the remainder sequence of (a, b) down to the GCD. The cofactors are
+// only accumulated when track_cofactors is set; the half-GCD steps need their
+// own transforms either way.
+static gcd_result remainder_sequence(const mod_poly &a, const mod_poly &b, bool track_cofactors) {
+    mod_poly c = a, d = b;
+    transform t;
+    while (!d.empty()) {
+        if (c.size() > d.size() && degree_of(c) >= HGCD_THRESHOLD) {
+            transform step = half_gcd(c, d);
+            std::tie(c, d) = step.apply(c, d);
+            if (track_cofactors) {
+                t = step.after(t);
+            }
+            if (d.empty()) {
+                break;
+            }
+        }
+        if (track_cofactors) {
+            euclid_step(c, d, t);
+        }
+        else {
+            mod_poly r = remainder(c, d);
+            c = std::move(d);
+            d = std::move(r);
+        }
+    }
+
+    if (c.empty()) {
+        return {};
+    }
+    uint32_t lead_inv = inverse(c.back());
+    auto scale = [&](mod_poly p) {
+        for (uint32_t &x : p) {
+            x = mul(x, lead_inv);
+        }
+        return p;
+    };
+    return {scale(c), scale(t.m00), scale(t.m01)};
+}
+
+gcd_result extended_gcd(const mod_poly &a, const mod_poly &b) {
+    if (a.size() < b.size()) {
+        gcd_result swapped = extended_gcd(b, a);
+        std::swap(swapped.s, swapped.t);
+        return swapped;
+    }
+    return remainder_sequence(a, b, true);
+}
+
+mod_poly gcd(const mod_poly &a, const mod_poly &b) {
+    return a.size() < b.size() ? remainder_sequence(b, a, false).g : remainder_sequence(a, b, false).g;
+}
+
+// Returns how many of candidates, taken in order, have a product above
+// 2 * bound, or 0 if all of them together do not.
+static size_t primes_needed(long double bound, const std::vector<ntt_prime> &candidates) {
+    // Keep clear of the sign bit: the combined value is formed modulo 2^128.
+    if (!(bound < 0x1p126L)) {
+        throw std::overflow_error("modular::crt_primes_needed: bound exceeds wide_coeff");
+    }
+    long double modulus = 1;
+    for (size_t k = 0; k < candidates.size(); k++) {
+        modulus *= candidates[k].mod;
+        // A relative margin absorbs the rounding of the long double products.
+        if (modulus > 2.001L * bound + 1) {
+            return k + 1;
+        }
+    }
+    return 0;
+}
+
+size_t crt_primes_needed(long double bound) {
+    size_t k = primes_needed(bound, std::vector<ntt_prime>(CRT_PRIMES, CRT_PRIMES + CRT_PRIME_COUNT));
+    if (k == 0) {
+        throw std::overflow_error("modular::crt_primes_needed: bound exceeds the CRT primes");
+    }
+    return k;
+}
+
+static uint32_t residue(int64_t c, uint32_t mod) {
+    int64_t r = c % static_cast<int64_t>(mod);
+    return static_cast<uint32_t>(r < 0 ? r + mod : r);
+}
+
+std::vector<wide_coeff> multiply_exact(const std::vector<int64_t> &a, const std::vector<int64_t> &b) {
+    if (a.empty() || b.empty()) {
+        return {};
+    }
+    auto max_abs = [](const std::vector<int64_t> &v) {
+        long double best = 0;
+        for (int64_t c : v) {
+            best = std::max(best, std::fabs(static_cast<long double>(c)));
+        }
+        return best;
+    };
+    long double bound = max_abs(a) * max_abs(b) * std::min(a.size(), b.size());
+    size_t product_length = a.size() + b.size() - 1;
+
+    // Only primes whose transforms are long enough can take part; check the
+    // full set first so a bound that no prime set covers reports overflow.
+    crt_primes_needed(bound);
+    std::vector<ntt_prime> primes;
+    for (const ntt_prime &p : CRT_PRIMES) {
+        if (product_length <= p.max_length) {
+            primes.push_back(p);
+        }
+    }
+    size_t k = primes_needed(bound, primes);
+    if (k == 0) {
+        throw std::length_error("modular::multiply_exact: product too long for enough CRT primes");
+    }
+
+    // Each prime's product is independent, so each gets its own thread.
+    std::vector<mod_poly> residues(k);
+    parallel_for(k, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t mod = primes[i].mod;
+            mod_poly ra(a.size()), rb;
+            for (size_t j = 0; j < a.size(); j++) {
+                ra[j] = residue(a[j], mod);
+            }
+            if (&a != &b) {
+                rb.resize(b.size());
+                for (size_t j = 0; j < b.size(); j++) {
+                    rb[j] = residue(b[j], mod);
+                }
+            }
+            trim(ra);
+            trim(rb);
+            residues[i] = multiply(ra, &a == &b ? ra : rb, mod, primes[i].root);
+            residues[i].resize(product_length);
+        }
+    });
+
+    // Garner: digit i is the value's mixed-radix digit in base p_0, ..., p_i,
+    // so value = sum digit_i * (p_0 * ... * p_{i-1}). inverses[i][j] is
+    // p_j^-1 mod p_i.
+    uint32_t inverses[CRT_PRIME_COUNT][CRT_PRIME_COUNT] = {};
+    unsigned __int128 radix[CRT_PRIME_COUNT];
+    unsigned __int128 modulus = 1;
+    for (size_t i = 0; i < k; i++) {
+        for (size_t j = 0; j < i; j++) {
+            inverses[i][j] = inverse(primes[j].mod % primes[i].mod, primes[i].mod);
+        }
+        radix[i] = modulus;
+        modulus *= primes[i].mod;
+    }
+
+    std::vector<wide_coeff> result(product_length);
+    parallel_for(product_length, 1 << 14, [&](size_t begin, size_t end) {
+        uint32_t digits[CRT_PRIME_COUNT];
+        for (size_t c = begin; c < end; c++) {
+            unsigned __int128 value = 0;
+            for (size_t i = 0; i < k; i++) {
+                uint32_t mod = primes[i].mod;
+                uint32_t x = residues[i][c];
+                for (size_t j = 0; j < i; j++) {
+                    x = mul(sub(x, digits[j] % mod, mod), inverses[i][j], mod);
+                }
+                digits[i] = x;
+                value += static_cast<unsigned __int128>(x) * radix[i];
+            }
+
+            // The digits of (M - 1) / 2 are (p_i - 1) / 2, so the value lies
+            // in the upper half, ie. is negative, iff its digits compare
+            // greater from the top. The wrap-around subtraction is then exact.
+            bool negative = false;
+            for (size_t i = k; i-- > 0; ) {
+                uint32_t half = (primes[i].mod - 1) / 2;
+                if (digits[i] != half) {
+                    negative = digits[i] > half;
+                    break;
+                }
+            }
+            if (negative) {
+                value -= modulus;
+            }
+            result[c] = static_cast<wide_coeff>(value);
+        }
+    });
+    return result;
+}
+
+} // namespace modular
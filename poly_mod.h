@@ -0,0 +1,266 @@
+#ifndef POLY_MOD_H
+#define POLY_MOD_H
+
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * Dense polynomial arithmetic over the integers modulo an NTT-friendly prime.
+ * A mod_poly stores the coefficient of x^i at index i with no trailing zeros,
+ * so the zero polynomial is the empty vector.
+ */
+namespace modular {
+
+using mod_poly = std::vector<uint32_t>;
+
+// 998244353 = 119 * 2^23 + 1, so transforms of up to 2^23 points exist.
+const uint32_t MOD = 998244353;
+const uint32_t ROOT = 3;
+
+// Below this many terms in either operand the schoolbook product is faster.
+const size_t NTT_THRESHOLD = 32;
+
+inline uint32_t add(uint32_t a, uint32_t b, uint32_t mod = MOD) {
+    uint32_t s = a + b;
+    return s >= mod ? s - mod : s;
+}
+
+inline uint32_t sub(uint32_t a, uint32_t b, uint32_t mod = MOD) {
+    return a >= b ? a - b : a + mod - b;
+}
+
+inline uint32_t mul(uint32_t a, uint32_t b, uint32_t mod = MOD) {
+    return static_cast<uint32_t>(static_cast<uint64_t>(a) * b % mod);
+}
+
+uint32_t pow_mod(uint32_t base, uint64_t exponent, uint32_t mod = MOD);
+
+/**
+ * @brief Returns the multiplicative inverse of a non-zero a modulo a prime
+ */
+uint32_t inverse(uint32_t a, uint32_t mod = MOD);
+
+/**
+ * @brief Maps an int coefficient to its residue in [0, MOD)
+ */
+uint32_t reduce(int64_t c);
+
+/**
+ * @brief Removes trailing zero coefficients
+ */
+void trim(mod_poly &a);
+
+/**
+ * @brief Twiddle factors for ntt(), one table per thread and (mod, root) pair.
+ *        Stage len reads entries [len / 2, len), which do not depend on the
+ *        table length, so a table built for N serves every transform of up to
+ *        N points and ntt() only rebuilds it for a longer one. Call trim() to
+ *        give the memory back.
+ */
+class ntt_workspace
+{
+public:
+    struct twiddles
+    {
+        uint32_t mod, root;
+        // w[k] for k in [len / 2, len) are the powers of a primitive len-th
+        // root of unity; w_shoup[k] is floor(w[k] * 2^32 / mod).
+        std::vector<uint32_t> w, w_shoup;
+    };
+
+private:
+    std::vector<twiddles> tables;
+
+public:
+    /**
+     * @brief Returns the calling thread's workspace
+     */
+    static ntt_workspace &local();
+
+    /**
+     * @brief Returns the table for (mod, root), grown to at least n points
+     */
+    const twiddles &table(uint32_t mod, uint32_t root, size_t n);
+
+    /**
+     * @brief Releases every table
+     */
+    void trim();
+
+    /**
+     * @brief Returns the bytes currently held by the workspace
+     */
+    size_t bytes_reserved() const;
+};
+
+/**
+ * @brief In-place number theoretic transform of a.size() points (a power of
+ *        two dividing mod - 1) with primitive root root, using the calling
+ *        thread's ntt_workspace twiddles
+ */
+void ntt(std::vector<uint32_t> &a, bool is_invert, uint32_t mod = MOD, uint32_t root = ROOT);
+
+/**
+ * @brief Product of a and b modulo mod, whose multiplicative group has
+ *        primitive root root and 2-adic order covering the product length
+ */
+mod_poly multiply(const mod_poly &a, const mod_poly &b, uint32_t mod = MOD, uint32_t root = ROOT);
+
+mod_poly add(const mod_poly &a, const mod_poly &b);
+
+mod_poly sub(const mod_poly &a, const mod_poly &b);
+
+/**
+ * @brief Returns the first n coefficients of 1 / a. a[0] must be non-zero.
+ */
+mod_poly inverse_series(const mod_poly &a, size_t n);
+
+/**
+ * @brief Returns (quotient, remainder) of a / b for a non-zero b, using a
+ *        Newton inverse of the reversed divisor when both are large
+ */
+std::pair<mod_poly, mod_poly> divmod(const mod_poly &a, const mod_poly &b);
+
+mod_poly remainder(const mod_poly &a, const mod_poly &b);
+
+/**
+ * @brief Horner evaluation at a single point
+ */
+uint32_t evaluate(const mod_poly &a, uint32_t x);
+
+/**
+ * The products (x - x_i) over every aligned block of points, level by level:
+ * node j of level L covers points [j * 2^L, (j + 1) * 2^L). Levels are built
+ * and walked in parallel.
+ */
+class subproduct_tree
+{
+private:
+    std::vector<uint32_t> points;
+    std::vector<std::vector<mod_poly>> levels;
+
+public:
+    explicit subproduct_tree(const std::vector<uint32_t> &points);
+
+    /**
+     * @brief Returns the product of (x - x_i) over every point
+     */
+    const mod_poly &root() const;
+
+    /**
+     * @brief Returns f evaluated at every point, reducing f down the tree
+     */
+    std::vector<uint32_t> evaluate(const mod_poly &f) const;
+
+    /**
+     * @brief Returns the unique polynomial of degree below the number of
+     *        points taking values[i] at point i. Points must be distinct.
+     */
+    mod_poly interpolate(const std::vector<uint32_t> &values) const;
+};
+
+// Point sets smaller than this are evaluated with Horner's rule per point.
+const size_t MULTIPOINT_THRESHOLD = 128;
+
+/**
+ * @brief Evaluates a at every point, through a subproduct tree when both the
+ *        degree and the number of points are large
+ */
+std::vector<uint32_t> evaluate(const mod_poly &a, const std::vector<uint32_t> &xs);
+
+/**
+ * @brief Returns the polynomial of degree below points.size() through every
+ *        (points[i], values[i]) in O(M(n) log n). Throws std::invalid_argument
+ *        if the sizes differ or two points coincide.
+ */
+mod_poly interpolate(const std::vector<uint32_t> &points, const std::vector<uint32_t> &values);
+
+// Below this degree the half-GCD recursion falls back to Euclid's algorithm.
+const size_t HGCD_THRESHOLD = 128;
+
+/**
+ * A 2x2 matrix of polynomials acting on pairs (a, b) as column vectors. The
+ * GCD algorithms accumulate their quotient steps in one.
+ */
+struct transform
+{
+    mod_poly m00 = {1}, m01, m10, m11 = {1};
+
+    std::pair<mod_poly, mod_poly> apply(const mod_poly &a, const mod_poly &b) const;
+
+    /**
+     * @brief Returns this * other, ie. other applied first
+     */
+    transform after(const transform &other) const;
+};
+
+/**
+ * @brief Returns the transform taking (a, b), deg a > deg b, to the first pair
+ *        of consecutive remainders (c, d) in their Euclidean sequence with
+ *        deg d < ceil(deg a / 2)
+ */
+transform half_gcd(const mod_poly &a, const mod_poly &b);
+
+struct gcd_result
+{
+    mod_poly g, s, t;
+};
+
+/**
+ * @brief Returns the monic GCD g of a and b with s * a + t * b = g, in
+ *        O(M(n) log n) through half_gcd
+ */
+gcd_result extended_gcd(const mod_poly &a, const mod_poly &b);
+
+mod_poly gcd(const mod_poly &a, const mod_poly &b);
+
+// Exact integer products wider than one prime, recovered by the Chinese
+// remainder theorem from products modulo several NTT primes.
+using wide_coeff = __int128;
+
+struct ntt_prime
+{
+    uint32_t mod;
+    uint32_t root;
+    // The longest power-of-two transform mod supports.
+    size_t max_length;
+};
+
+const ntt_prime CRT_PRIMES[] = {
+    {998244353, 3, size_t(1) << 23},
+    {167772161, 3, size_t(1) << 25},
+    {469762049, 3, size_t(1) << 26},
+    {754974721, 11, size_t(1) << 24},
+    {1004535809, 3, size_t(1) << 21},
+};
+const size_t CRT_PRIME_COUNT = sizeof(CRT_PRIMES) / sizeof(CRT_PRIMES[0]);
+
+/**
+ * @brief Returns how many of CRT_PRIMES are needed, taken in order, for their
+ *        product to exceed 2 * bound, so every integer of absolute value at
+ *        most bound has a unique residue vector
+ *
+ * @throws std::overflow_error
+ *  If bound does not fit a wide_coeff
+ */
+size_t crt_primes_needed(long double bound);
+
+/**
+ * @brief Returns the exact product of a and b, all a.size() + b.size() - 1
+ *        coefficients. The primes are taken in order from those whose
+ *        transforms hold the product, as many as the largest input
+ *        coefficients and the shorter length require; the per-prime products
+ *        run in parallel and are combined with Garner's algorithm.
+ *
+ * @throws std::overflow_error
+ *  If a product coefficient could exceed a wide_coeff
+ * @throws std::length_error
+ *  If too few primes can transform a product this long to cover the bound
+ */
+std::vector<wide_coeff> multiply_exact(const std::vector<int64_t> &a, const std::vector<int64_t> &b);
+
+} // namespace modular
+
+#endif
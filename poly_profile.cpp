@@ -0,0 +1,209 @@
+#include "poly_profile.h"
+
+#ifdef POLY_PROFILE
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <iomanip>
+#include <mutex>
+#include <new>
+
+namespace profile {
+
+static std::mutex profile_mutex;
+static std::vector<op_record> all_records;
+static std::map<std::string, op_counter> all_counters;
+static thread_local op_scope *current_scope = nullptr;
+
+static thread_local std::atomic<size_t> thread_allocated{0};
+static thread_local std::atomic<size_t> *allocation_target = nullptr;
+
+std::atomic<size_t> *allocation_counter() {
+    return allocation_target ? allocation_target : &thread_allocated;
+}
+
+allocation_scope::allocation_scope(std::atomic<size_t> *counter) : previous(allocation_target) {
+    allocation_target = counter;
+}
+
+allocation_scope::~allocation_scope() {
+    allocation_target = previous;
+}
+
+
+static double now_us() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+op_scope::op_scope(const char *op) : parent(current_scope), allocated_at_start(allocation_counter() -> load()) {
+    record.op = op;
+    record.thread = std::this_thread::get_id();
+    record.start_us = now_us();
+    current_scope = this;
+}
+
+op_scope::~op_scope() {
+    double now = now_us();
+    close_phase(now);
+    record.duration_us = now - record.start_us;
+    record.bytes_allocated = allocation_counter() -> load() - allocated_at_start;
+    current_scope = parent;
+
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    op_counter &counter = all_counters[record.op + "/" + (record.path.empty() ? "default" : record.path)];
+    counter.calls++;
+    counter.total_us += record.duration_us;
+    counter.bytes_allocated += record.bytes_allocated;
+    counter.workspace_bytes += record.workspace_bytes;
+    if (all_records.size() < MAX_RECORDS) {
+        all_records.push_back(std::move(record));
+    }
+}
+
+op_scope *op_scope::current() {
+    return current_scope;
+}
+
+void op_scope::close_phase(double now) {
+    if (phase_start >= 0) {
+        std::get<2>(record.phases.back()) = now - phase_start;
+        phase_start = -1;
+    }
+}
+
+void op_scope::phase(const char *name) {
+    double now = now_us();
+    close_phase(now);
+    record.phases.emplace_back(name, now, 0);
+    phase_start = now;
+}
+
+void op_scope::set_path(const char *path) {
+    record.path = path;
+}
+
+void op_scope::set_sizes(size_t lhs_terms, size_t rhs_terms) {
+    record.lhs_terms = lhs_terms;
+    record.rhs_terms = rhs_terms;
+}
+
+void op_scope::set_result_terms(size_t terms) {
+    record.result_terms = terms;
+}
+
+void op_scope::set_transform_size(size_t n) {
+    record.transform_size = n;
+}
+
+void op_scope::add_workspace_bytes(size_t bytes) {
+    record.workspace_bytes += bytes;
+}
+
+void op_scope::set_threads(size_t threads) {
+    record.threads = std::max(record.threads, threads);
+}
+
+std::vector<op_record> records() {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    return all_records;
+}
+
+std::map<std::string, op_counter> counters() {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    return all_counters;
+}
+
+void reset() {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    all_records.clear();
+    all_counters.clear();
+}
+
+void dump_chrome_trace(std::ostream &out) {
+    std::vector<op_record> snapshot = records();
+
+    // Timestamps are microseconds since start-up; fixed notation keeps them
+    // exact to the nanosecond however long the process has run.
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    auto event = [&](const std::string &name, size_t tid, double ts, double dur) {
+        out << (first ? "" : ",") << "\n{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+            << ",\"ts\":" << ts << ",\"dur\":" << dur;
+        first = false;
+    };
+
+    for (const op_record &r : snapshot) {
+        size_t tid = std::hash<std::thread::id>{}(r.thread) % 100000;
+        event(r.op, tid, r.start_us, r.duration_us);
+        out << ",\"args\":{\"path\":\"" << r.path << "\",\"lhs_terms\":" << r.lhs_terms
+            << ",\"rhs_terms\":" << r.rhs_terms << ",\"result_terms\":" << r.result_terms
+            << ",\"transform_size\":" << r.transform_size << ",\"bytes_allocated\":" << r.bytes_allocated
+            << ",\"workspace_bytes\":" << r.workspace_bytes
+            << ",\"threads\":" << r.threads << "}}";
+
+        for (const auto &[name, start, duration] : r.phases) {
+            event(name, tid, start, duration);
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+} // namespace profile
+
+// The global allocation functions are replaced so that every allocation, from
+// term maps and arena blocks to std::vector scratch, is charged to the calling
+// thread's counter. The remaining forms forward to these by default.
+static void *counted_allocate(size_t bytes, size_t alignment) {
+    profile::allocation_counter() -> fetch_add(bytes, std::memory_order_relaxed);
+    bytes = std::max<size_t>(bytes, 1);
+    void *p = alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__
+        ? std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment)
+        : std::malloc(bytes);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new(size_t bytes) {
+    return counted_allocate(bytes, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new[](size_t bytes) {
+    return counted_allocate(bytes, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new(size_t bytes, std::align_val_t alignment) {
+    return counted_allocate(bytes, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t bytes, std::align_val_t alignment) {
+    return counted_allocate(bytes, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+#endif
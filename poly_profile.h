@@ -0,0 +1,173 @@
+#ifndef POLY_PROFILE_H
+#define POLY_PROFILE_H
+
+/**
+ * Optional instrumentation for polynomial operations. Build with
+ * -DPOLY_PROFILE to record, per operation, which path ran, the transform
+ * size, bytes allocated, threads used and the time spent in each phase.
+ * Without the flag every POLY_PROFILE_* macro expands to nothing.
+ *
+ * Bytes are counted by replacing the global operator new, so term maps,
+ * arena and pool blocks, FFT buffers and NTT vectors are all seen.
+ */
+
+#ifdef POLY_PROFILE
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace profile {
+
+struct op_record
+{
+    std::string op;
+    std::string path;
+    size_t lhs_terms = 0;
+    size_t rhs_terms = 0;
+    size_t result_terms = 0;
+    size_t transform_size = 0;
+    // Bytes passed to operator new on this thread and on the helper threads
+    // the operation started, nested operations included. Frees are not
+    // subtracted.
+    size_t bytes_allocated = 0;
+    // The fft_workspace growth within bytes_allocated; 0 once buffers are warm.
+    size_t workspace_bytes = 0;
+    // The most threads any phase ran on.
+    size_t threads = 1;
+    std::thread::id thread;
+    double start_us = 0;
+    double duration_us = 0;
+    // (phase name, start in us, duration in us), in the order they ran
+    std::vector<std::tuple<std::string, double, double>> phases;
+};
+
+struct op_counter
+{
+    size_t calls = 0;
+    double total_us = 0;
+    size_t bytes_allocated = 0;
+    size_t workspace_bytes = 0;
+};
+
+/**
+ * @brief Times one operation on the calling thread. While alive it is the
+ *        target of the POLY_PROFILE_SET_* and POLY_PROFILE_PHASE macros.
+ */
+class op_scope
+{
+private:
+    op_record record;
+    op_scope *parent;
+    double phase_start = -1;
+    size_t allocated_at_start;
+
+    void close_phase(double now);
+
+public:
+    explicit op_scope(const char *op);
+    ~op_scope();
+
+    op_scope(const op_scope &) = delete;
+    op_scope &operator=(const op_scope &) = delete;
+
+    static op_scope *current();
+
+    void phase(const char *name);
+    void set_path(const char *path);
+    void set_sizes(size_t lhs_terms, size_t rhs_terms);
+    void set_result_terms(size_t terms);
+    void set_transform_size(size_t n);
+    /**
+     * @brief Adds bytes the fft_workspace grew by while this scope is current
+     */
+    void add_workspace_bytes(size_t bytes);
+
+    /**
+     * @brief Raises the recorded thread count to threads if it is higher
+     */
+    void set_threads(size_t threads);
+};
+
+/**
+ * @brief Returns the counter this thread's allocations are added to: its own,
+ *        or the one adopted through an allocation_scope
+ */
+std::atomic<size_t> *allocation_counter();
+
+/**
+ * @brief Adds the calling thread's allocations to counter while alive, so a
+ *        helper thread charges the operation that started it.
+ */
+class allocation_scope
+{
+private:
+    std::atomic<size_t> *previous;
+
+public:
+    explicit allocation_scope(std::atomic<size_t> *counter);
+    ~allocation_scope();
+
+    allocation_scope(const allocation_scope &) = delete;
+    allocation_scope &operator=(const allocation_scope &) = delete;
+};
+
+/**
+ * @brief Returns a copy of every operation recorded so far, oldest first.
+ *        At most MAX_RECORDS are kept; the counters keep counting past that.
+ */
+std::vector<op_record> records();
+
+/**
+ * @brief Returns call counts, total time and bytes keyed by "op/path",
+ *        ie. "multiply/fft" or "multiply/sparse".
+ */
+std::map<std::string, op_counter> counters();
+
+/**
+ * @brief Clears all records and counters.
+ */
+void reset();
+
+/**
+ * @brief Writes the records in Chrome trace event format (JSON), viewable in
+ *        chrome://tracing or Perfetto.
+ */
+void dump_chrome_trace(std::ostream &out);
+
+const size_t MAX_RECORDS = 1 << 16;
+
+} // namespace profile
+
+#define POLY_PROFILE_CONCAT_INNER(a, b) a##b
+#define POLY_PROFILE_CONCAT(a, b) POLY_PROFILE_CONCAT_INNER(a, b)
+#define POLY_PROFILE_OP(name) profile::op_scope POLY_PROFILE_CONCAT(poly_profile_op_, __LINE__)(name)
+#define POLY_PROFILE_CALL(call) do { if (profile::op_scope *s_ = profile::op_scope::current()) s_ -> call; } while (0)
+#define POLY_PROFILE_PHASE(name) POLY_PROFILE_CALL(phase(name))
+#define POLY_PROFILE_SET_PATH(path) POLY_PROFILE_CALL(set_path(path))
+#define POLY_PROFILE_SET_SIZES(lhs, rhs) POLY_PROFILE_CALL(set_sizes(lhs, rhs))
+#define POLY_PROFILE_SET_RESULT(terms) POLY_PROFILE_CALL(set_result_terms(terms))
+#define POLY_PROFILE_SET_TRANSFORM(n) POLY_PROFILE_CALL(set_transform_size(n))
+#define POLY_PROFILE_ADD_WORKSPACE_BYTES(bytes) POLY_PROFILE_CALL(add_workspace_bytes(bytes))
+#define POLY_PROFILE_SET_THREADS(threads) POLY_PROFILE_CALL(set_threads(threads))
+
+#else
+
+#define POLY_PROFILE_OP(name) ((void)0)
+#define POLY_PROFILE_PHASE(name) ((void)0)
+#define POLY_PROFILE_SET_PATH(path) ((void)0)
+#define POLY_PROFILE_SET_SIZES(lhs, rhs) ((void)0)
+#define POLY_PROFILE_SET_RESULT(terms) ((void)0)
+#define POLY_PROFILE_SET_TRANSFORM(n) ((void)0)
+#define POLY_PROFILE_ADD_WORKSPACE_BYTES(bytes) ((void)0)
+#define POLY_PROFILE_SET_THREADS(threads) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,415 @@
+#include "poly_shard.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace poly_shard {
+
+static std::system_error last_error(const char *what) {
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+static void write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw last_error("poly_shard::write_frame");
+        }
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+}
+
+// Returns how many bytes were read before the end of stream.
+static size_t read_all(int fd, char *data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t got = read(fd, data + done, size - done);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw last_error("poly_shard::read_frame");
+        }
+        if (got == 0) {
+            break;
+        }
+        done += static_cast<size_t>(got);
+    }
+    return done;
+}
+
+void write_frame(int fd, const std::string &payload) {
+    if (payload.size() > MAX_FRAME) {
+        throw std::length_error("poly_shard::write_frame: payload exceeds MAX_FRAME");
+    }
+    char header[8];
+    uint64_t length = payload.size();
+    for (int i = 0; i < 8; i++) {
+        header[i] = static_cast<char>(length >> (8 * i));
+    }
+    write_all(fd, header, sizeof(header));
+    write_all(fd, payload.data(), payload.size());
+}
+
+bool read_frame(int fd, std::string &payload) {
+    unsigned char header[8];
+    size_t got = read_all(fd, reinterpret_cast<char *>(header), sizeof(header));
+    if (got == 0) {
+        return false;
+    }
+    uint64_t length = 0;
+    for (int i = 0; i < 8; i++) {
+        length |= static_cast<uint64_t>(header[i]) << (8 * i);
+    }
+    if (got < sizeof(header)) {
+        throw std::system_error(std::make_error_code(std::errc::connection_reset),
+                                "poly_shard::read_frame: stream ended inside a frame");
+    }
+    if (length > MAX_FRAME) {
+        throw std::length_error("poly_shard::read_frame: frame exceeds MAX_FRAME");
+    }
+    payload.resize(length);
+    if (read_all(fd, payload.data(), length) < length) {
+        throw std::system_error(std::make_error_code(std::errc::connection_reset),
+                                "poly_shard::read_frame: stream ended inside a frame");
+    }
+    return true;
+}
+
+void serve(int fd) {
+    std::string request;
+    while (read_frame(fd, request)) {
+        std::string reply;
+        try {
+            std::istringstream in(request);
+            polynomial a = polynomial::parse(in);
+            polynomial b = polynomial::parse(in);
+            std::ostringstream out;
+            (a * b).write(out);
+            reply = out.str();
+        }
+        catch (const std::exception &e) {
+            reply = std::string("!") + e.what();
+        }
+        write_frame(fd, reply);
+    }
+}
+
+static sockaddr_un unix_address(const std::string &path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("poly_shard: socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+void serve_unix(const std::string &path) {
+    sockaddr_un address = unix_address(path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        throw last_error("poly_shard::serve_unix: socket");
+    }
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listener, 8) < 0) {
+        int saved = errno;
+        close(listener);
+        errno = saved;
+        throw last_error("poly_shard::serve_unix: bind");
+    }
+
+    while (true) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            throw last_error("poly_shard::serve_unix: accept");
+        }
+        try {
+            serve(client);
+        }
+        catch (const std::exception &e) {
+            std::cerr << "poly_shard worker: " << e.what() << std::endl;
+        }
+        close(client);
+    }
+}
+
+int connect_unix(const std::string &path) {
+    sockaddr_un address = unix_address(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw last_error("poly_shard::connect_unix: socket");
+    }
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        throw last_error("poly_shard::connect_unix: connect");
+    }
+    return fd;
+}
+
+coordinator::coordinator(std::vector<int> fds, std::vector<pid_t> children)
+    : fds(std::move(fds)), children(std::move(children)) {}
+
+coordinator::coordinator(coordinator &&other) noexcept
+    : fds(std::move(other.fds)), children(std::move(other.children)), out_of_step(other.out_of_step) {
+    other.fds.clear();
+    other.children.clear();
+}
+
+coordinator::~coordinator() {
+    // Closing a worker's socket ends its serve() loop.
+    for (int fd : fds) {
+        close(fd);
+    }
+    for (pid_t child : children) {
+        waitpid(child, nullptr, 0);
+    }
+}
+
+// Counts the live threads of this process, one entry each in /proc/self/task.
+static size_t thread_count() {
+    DIR *tasks = opendir("/proc/self/task");
+    if (!tasks) {
+        throw last_error("poly_shard: cannot list /proc/self/task");
+    }
+    size_t count = 0;
+    while (dirent *entry = readdir(tasks)) {
+        if (entry -> d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(tasks);
+    return count;
+}
+
+coordinator coordinator::spawn(size_t count) {
+    if (count == 0) {
+        throw std::logic_error("poly_shard::coordinator::spawn: no workers requested");
+    }
+    if (thread_count() > 1) {
+        throw std::logic_error("poly_shard::coordinator::spawn: the process is already multithreaded; "
+                               "spawn workers before starting any threads");
+    }
+    coordinator result({}, {});
+    for (size_t i = 0; i < count; i++) {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+            throw last_error("poly_shard::coordinator::spawn: socketpair");
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            int saved = errno;
+            close(pair[0]);
+            close(pair[1]);
+            errno = saved;
+            throw last_error("poly_shard::coordinator::spawn: fork");
+        }
+        if (pid == 0) {
+            // Drop the parent's ends, including earlier workers', so every
+            // worker sees end of stream when the coordinator closes.
+            close(pair[0]);
+            for (int fd : result.fds) {
+                close(fd);
+            }
+            int status = 0;
+            try {
+                serve(pair[1]);
+            }
+            catch (const std::exception &e) {
+                std::cerr << "poly_shard worker: " << e.what() << std::endl;
+                status = 1;
+            }
+            _exit(status);
+        }
+        close(pair[1]);
+        result.fds.push_back(pair[0]);
+        result.children.push_back(pid);
+    }
+    return result;
+}
+
+coordinator coordinator::connect(const std::vector<std::string> &paths) {
+    if (paths.empty()) {
+        throw std::invalid_argument("poly_shard::coordinator::connect: no worker sockets given");
+    }
+    coordinator result({}, {});
+    for (const std::string &path : paths) {
+        result.fds.push_back(connect_unix(path));
+    }
+    return result;
+}
+
+// The non-empty blocks of p as (first power, terms shifted down to it).
+static std::vector<std::pair<power, polynomial>> split_blocks(const polynomial &p, size_t block_size) {
+    std::vector<std::pair<power, std::vector<std::pair<power, coeff>>>> blocks;
+    auto terms = p.canonical_form();
+    for (auto i = terms.rbegin(); i != terms.rend(); i++) {
+        if (i -> second == 0) {
+            continue;
+        }
+        power offset = i -> first / block_size * block_size;
+        if (blocks.empty() || blocks.back().first != offset) {
+            blocks.emplace_back(offset, std::vector<std::pair<power, coeff>>());
+        }
+        blocks.back().second.emplace_back(i -> first - offset, i -> second);
+    }
+
+    std::vector<std::pair<power, polynomial>> result;
+    for (const auto& [offset, block] : blocks) {
+        result.emplace_back(offset, polynomial(block.begin(), block.end()));
+    }
+    return result;
+}
+
+polynomial coordinator::multiply(const polynomial &a, const polynomial &b, size_t block_size) {
+    if (fds.empty()) {
+        throw std::logic_error("poly_shard::coordinator::multiply: no workers");
+    }
+    if (out_of_step) {
+        throw std::logic_error("poly_shard::coordinator::multiply: an earlier multiply left the workers out of step");
+    }
+    block_size = std::max<size_t>(block_size, 1);
+    auto blocks_a = split_blocks(a, block_size);
+    auto blocks_b = split_blocks(b, block_size);
+    if (blocks_a.empty() || blocks_b.empty()) {
+        return polynomial();
+    }
+
+    std::vector<std::pair<size_t, size_t>> jobs;
+    for (size_t i = 0; i < blocks_a.size(); i++) {
+        for (size_t j = 0; j < blocks_b.size(); j++) {
+            jobs.emplace_back(i, j);
+        }
+    }
+
+    // Block products overlap, so they are added into one accumulator as they
+    // arrive: a dense array when the result's span is comparable to the
+    // operands' term counts, a map for sparse operands of large degree.
+    // Sums wrap modulo 2^32 like coeff arithmetic.
+    size_t span = a.find_degree_of() + b.find_degree_of() + 1;
+    bool dense = span <= 4 * (a.term_count() + b.term_count());
+    std::vector<uint32_t> dense_sum(dense ? span : 0);
+    std::map<power, uint32_t> sparse_sum;
+    auto accumulate = [&](power p, coeff c) {
+        if (dense) {
+            dense_sum[p] += static_cast<uint32_t>(c);
+        }
+        else {
+            sparse_sum[p] += static_cast<uint32_t>(c);
+        }
+    };
+
+    // Any exception past this point may leave a request half written or a
+    // reply unread; only a run that drains every reply clears the flag.
+    out_of_step = true;
+
+    // in_flight[w] is the job worker w is working on, or jobs.size() if idle.
+    std::vector<size_t> in_flight(fds.size(), jobs.size());
+    size_t next_job = 0, busy = 0;
+    std::exception_ptr failure;
+    auto dispatch = [&](size_t w) {
+        if (failure || next_job == jobs.size()) {
+            return;
+        }
+        std::ostringstream request;
+        blocks_a[jobs[next_job].first].second.write(request);
+        blocks_b[jobs[next_job].second].second.write(request);
+        write_frame(fds[w], request.str());
+        in_flight[w] = next_job++;
+        busy++;
+    };
+    for (size_t w = 0; w < fds.size(); w++) {
+        dispatch(w);
+    }
+
+    std::vector<pollfd> waiting(fds.size());
+    std::string reply;
+    while (busy > 0) {
+        for (size_t w = 0; w < fds.size(); w++) {
+            waiting[w] = {fds[w], static_cast<short>(in_flight[w] < jobs.size() ? POLLIN : 0), 0};
+        }
+        if (poll(waiting.data(), waiting.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw last_error("poly_shard::coordinator::multiply: poll");
+        }
+
+        for (size_t w = 0; w < fds.size(); w++) {
+            if (in_flight[w] == jobs.size() || waiting[w].revents == 0) {
+                continue;
+            }
+            if (!read_frame(fds[w], reply)) {
+                throw std::system_error(std::make_error_code(std::errc::connection_reset),
+                                        "poly_shard::coordinator::multiply: worker closed");
+            }
+            auto [i, j] = jobs[in_flight[w]];
+            in_flight[w] = jobs.size();
+            busy--;
+
+            // Keep draining after a rejected pair so every connection is
+            // back in step before the error is raised.
+            if (!reply.empty() && reply[0] == '!') {
+                if (!failure) {
+                    failure = std::make_exception_ptr(std::runtime_error("poly_shard worker: " + reply.substr(1)));
+                }
+            }
+            else if (!failure) {
+                std::istringstream in(reply);
+                power shift = blocks_a[i].first + blocks_b[j].first;
+                polynomial::parse(in).for_each_term([&](power p, coeff c) { accumulate(p + shift, c); });
+            }
+            dispatch(w);
+        }
+    }
+    out_of_step = false;
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    std::vector<std::pair<power, coeff>> terms;
+    if (dense) {
+        for (size_t p = 0; p < span; p++) {
+            if (dense_sum[p] != 0) {
+                terms.emplace_back(p, static_cast<coeff>(dense_sum[p]));
+            }
+        }
+    }
+    else {
+        for (const auto& [p, c] : sparse_sum) {
+            if (c != 0) {
+                terms.emplace_back(p, static_cast<coeff>(c));
+            }
+        }
+    }
+    if (terms.empty()) {
+        return polynomial();
+    }
+    return polynomial(terms.begin(), terms.end());
+}
+
+} // namespace poly_shard
@@ -0,0 +1,131 @@
+#ifndef POLY_SHARD_H
+#define POLY_SHARD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include "poly.h"
+
+/**
+ * Sharded multiplication across worker processes on one machine. The
+ * coordinator cuts both operands into blocks of consecutive powers, sends
+ * each pair of non-empty blocks to a worker over a stream socket, and
+ * overlap-adds the block products back into one polynomial. Operands and
+ * results travel in the polynomial::write() text format, one length-prefixed
+ * frame per message, and workers multiply with polynomial::operator*.
+ */
+namespace poly_shard {
+
+/**
+ * @brief Largest payload a frame may carry. read_frame() checks the length
+ *        against it before allocating, since any local process can connect
+ *        to a worker.
+ */
+const uint64_t MAX_FRAME = uint64_t(1) << 30;
+
+/**
+ * @brief Writes one frame: an 8 byte little-endian length, then payload
+ *
+ * @throws std::length_error
+ *  If payload is longer than MAX_FRAME
+ * @throws std::system_error
+ *  If the peer is gone or the write fails
+ */
+void write_frame(int fd, const std::string &payload);
+
+/**
+ * @brief Reads one frame into payload. Returns false on a clean end of
+ *        stream before the frame starts.
+ *
+ * @throws std::length_error
+ *  If the frame claims more than MAX_FRAME bytes; nothing is read past its
+ *  header, so the stream cannot be used further
+ * @throws std::system_error
+ *  If the read fails or the stream ends inside a frame
+ */
+bool read_frame(int fd, std::string &payload);
+
+/**
+ * @brief Answers block products on fd until the peer closes it. Each request
+ *        holds two polynomials; the reply holds their product, or "!" and a
+ *        message if the request could not be parsed.
+ */
+void serve(int fd);
+
+/**
+ * @brief Listens on a unix socket at path (replacing a stale one) and serves
+ *        each coordinator that connects, one at a time. Does not return.
+ */
+[[noreturn]] void serve_unix(const std::string &path);
+
+/**
+ * @brief Connects to a worker listening on a unix socket at path
+ */
+int connect_unix(const std::string &path);
+
+class coordinator
+{
+private:
+    std::vector<int> fds;
+    // Forked children to reap; empty for workers reached over unix sockets.
+    std::vector<pid_t> children;
+    // Set while a multiply() that failed part way may have left replies
+    // unread or a request half written; the connections are then unusable.
+    bool out_of_step = false;
+
+    explicit coordinator(std::vector<int> fds, std::vector<pid_t> children);
+
+public:
+    /**
+     * @brief Forks count workers, each serving its end of a socketpair.
+     *        fork() copies only the calling thread, so a child of a
+     *        multithreaded process could inherit locks held by threads that
+     *        no longer exist. Call this before the process starts any thread
+     *        that is still running, eg. before the first poly_async call.
+     *
+     * @throws std::logic_error
+     *  If the process has more than one thread, or count is 0
+     */
+    static coordinator spawn(size_t count);
+
+    /**
+     * @brief Connects to workers already serving on unix sockets at paths
+     *
+     * @throws std::invalid_argument
+     *  If paths is empty
+     */
+    static coordinator connect(const std::vector<std::string> &paths);
+
+    coordinator(coordinator &&other) noexcept;
+    coordinator &operator=(coordinator &&) = delete;
+    coordinator(const coordinator &) = delete;
+
+    /**
+     * @brief Closes every connection and reaps forked workers
+     */
+    ~coordinator();
+
+    size_t workers() const { return fds.size(); }
+
+    /**
+     * @brief Returns a * b, splitting both into blocks of block_size powers.
+     *        Every worker has one block pair in flight at a time, and each
+     *        block product is added into the result as its reply arrives, so
+     *        only one reply is held at once.
+     *
+     * @throws std::logic_error
+     *  If the coordinator has no workers, eg. after being moved from, or an
+     *  earlier multiply() failed with a connection error
+     * @throws std::runtime_error
+     *  If a worker rejects a block pair
+     * @throws std::system_error
+     *  If a worker's connection fails
+     */
+    polynomial multiply(const polynomial &a, const polynomial &b, size_t block_size);
+};
+
+} // namespace poly_shard
+
+#endif
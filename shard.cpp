@@ -0,0 +1,56 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "poly.h"
+#include "poly_shard.h"
+
+// Runs the sharded multiply as separate processes on one machine:
+//
+//   shard worker <socket>
+//       serve block products on a unix socket
+//   shard multiply <input> <block_size> --spawn <count>
+//   shard multiply <input> <block_size> <socket>...
+//       multiply the first two polynomials in input, in the format
+//       polynomial::parse() reads, on forked or already running workers,
+//       and write the product to stdout
+
+static int usage() {
+    std::cerr << "usage: shard worker <socket>" << std::endl
+              << "       shard multiply <input> <block_size> --spawn <count>" << std::endl
+              << "       shard multiply <input> <block_size> <socket>..." << std::endl;
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    try {
+        if (args.size() == 2 && args[0] == "worker") {
+            poly_shard::serve_unix(args[1]);
+        }
+        if (args.size() < 4 || args[0] != "multiply") {
+            return usage();
+        }
+
+        std::ifstream input(args[1]);
+        if (!input) {
+            std::cerr << "shard: cannot open " << args[1] << std::endl;
+            return 1;
+        }
+        polynomial a = polynomial::parse(input);
+        polynomial b = polynomial::parse(input);
+        size_t block_size = std::stoull(args[2]);
+
+        std::vector<std::string> sockets(args.begin() + 3, args.end());
+        poly_shard::coordinator workers = args[3] == "--spawn" && args.size() == 5
+            ? poly_shard::coordinator::spawn(std::stoull(args[4]))
+            : poly_shard::coordinator::connect(sockets);
+        workers.multiply(a, b, block_size).write(std::cout);
+    }
+    catch (const std::exception &e) {
+        std::cerr << "shard: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}